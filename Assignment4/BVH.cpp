@@ -0,0 +1,289 @@
+// ==========================================================================
+// Bounding Volume Hierarchy
+//  - binned surface area heuristic build over spheres, triangles and mesh
+//    triangles, costed in blocks, with each leaf packed into blocks
+// ==========================================================================
+
+#include "BVH.h"
+#include "SceneCache.h"
+#include "RenderStats.h"
+#include "TraceRecorder.h"
+#include "PerfCounters.h"
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+// --------------------------------------------------------------------------
+
+namespace
+{
+    // number of candidate split planes tried per node
+    const int BinCount = 12;
+
+    // keeps the traversal stack in BVH::Traverse from overflowing
+    const int MaxDepth = 60;
+
+    // cost of visiting a node relative to testing one block of primitives
+    const float TraversalCost = 1.f;
+    const float BlockCost = 1.5f;
+
+    // a leaf of count primitives is tested a whole block at a time
+    float LeafCost(int count)
+    {
+        return BlockCost * float((count + BlockWidth - 1) / BlockWidth);
+    }
+
+    float SurfaceArea(const vec3 &lower, const vec3 &upper)
+    {
+        vec3 d = upper - lower;
+        return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+void BVH::Build(const sceneData &scene)
+{
+    STAT_TIMER(PHASE_BUILD);
+    TRACE_SCOPE("build BVH");
+    PERF_SCOPE(PERF_BUILD);
+    m_nodes.clear();
+    m_leaves.clear();
+    m_triangleBlocks.clear();
+    m_sphereBlocks.clear();
+
+    const vector<preparedSphere> &spheres = scene.preparedSpheres;
+    const vector<preparedTriangle> &triangles = scene.preparedTriangles;
+    int meshTriangles = scene.MeshTriangleCount();
+
+    vector<BuildItem> items;
+    items.reserve(spheres.size() + triangles.size() + meshTriangles);
+
+    for (int i = 0; i < spheres.size(); ++i)
+    {
+        const preparedSphere &s = spheres[i];
+        BuildItem item;
+        item.lower = s.center - vec3(s.radius);
+        item.upper = s.center + vec3(s.radius);
+        item.centroid = s.center;
+        item.primitive.type = SPHERE_PRIMITIVE;
+        item.primitive.index = i;
+        items.push_back(item);
+    }
+
+    for (int i = 0; i < triangles.size(); ++i)
+    {
+        const preparedTriangle &t = triangles[i];
+        BuildItem item;
+        item.lower = min(t.P0, min(t.P1, t.P2));
+        item.upper = max(t.P0, max(t.P1, t.P2));
+        item.centroid = (t.P0 + t.P1 + t.P2) / 3.f;
+        item.primitive.type = TRIANGLE_PRIMITIVE;
+        item.primitive.index = i;
+        items.push_back(item);
+    }
+
+    for (int i = 0; i < meshTriangles; ++i)
+    {
+        const vec3 &P0 = scene.meshVertices[scene.meshIndices[3 * i]];
+        const vec3 &P1 = scene.meshVertices[scene.meshIndices[3 * i + 1]];
+        const vec3 &P2 = scene.meshVertices[scene.meshIndices[3 * i + 2]];
+        BuildItem item;
+        item.lower = min(P0, min(P1, P2));
+        item.upper = max(P0, max(P1, P2));
+        item.centroid = (P0 + P1 + P2) / 3.f;
+        item.primitive.type = MESH_TRIANGLE_PRIMITIVE;
+        item.primitive.index = i;
+        items.push_back(item);
+    }
+
+    if (items.empty()) return;
+
+    // a binary tree over n leaves has fewer than 2n nodes
+    m_nodes.reserve(2 * items.size());
+    BuildNode(scene, items, 0, int(items.size()), 0);
+}
+
+// --------------------------------------------------------------------------
+
+int BVH::BuildNode(const sceneData &scene, vector<BuildItem> &items, int begin,
+                   int end, int depth)
+{
+    int index = int(m_nodes.size());
+    m_nodes.push_back(Node());
+
+    // bounds of everything in this node, and of the primitive centroids
+    vec3 lower = items[begin].lower, upper = items[begin].upper;
+    vec3 centroidLower = items[begin].centroid, centroidUpper = items[begin].centroid;
+    for (int i = begin + 1; i < end; ++i)
+    {
+        lower = min(lower, items[i].lower);
+        upper = max(upper, items[i].upper);
+        centroidLower = min(centroidLower, items[i].centroid);
+        centroidUpper = max(centroidUpper, items[i].centroid);
+    }
+    m_nodes[index].lower = lower;
+    m_nodes[index].upper = upper;
+
+    int count = end - begin;
+
+    // split along the axis where the centroids are spread out the most
+    vec3 extent = centroidUpper - centroidLower;
+    int axis = 0;
+    if (extent.y > extent[axis]) axis = 1;
+    if (extent.z > extent[axis]) axis = 2;
+
+    int mid = begin;
+    if (count > 1 && depth < MaxDepth && extent[axis] > 0.f)
+    {
+        // drop every centroid into one of BinCount equal slices
+        int binCounts[BinCount] = { 0 };
+        vec3 binLower[BinCount], binUpper[BinCount];
+        float scale = BinCount / extent[axis];
+        for (int i = begin; i < end; ++i)
+        {
+            int bin = std::min(BinCount - 1,
+                int((items[i].centroid[axis] - centroidLower[axis]) * scale));
+            if (binCounts[bin]++ == 0)
+            {
+                binLower[bin] = items[i].lower;
+                binUpper[bin] = items[i].upper;
+            }
+            else
+            {
+                binLower[bin] = min(binLower[bin], items[i].lower);
+                binUpper[bin] = max(binUpper[bin], items[i].upper);
+            }
+        }
+
+        // sweep from the right to get the cost of everything past each plane
+        float rightArea[BinCount];
+        int rightCount[BinCount];
+        vec3 sweepLower, sweepUpper;
+        int sweepCount = 0;
+        for (int b = BinCount - 1; b > 0; --b)
+        {
+            if (binCounts[b] > 0)
+            {
+                sweepLower = sweepCount ? min(sweepLower, binLower[b]) : binLower[b];
+                sweepUpper = sweepCount ? max(sweepUpper, binUpper[b]) : binUpper[b];
+                sweepCount += binCounts[b];
+            }
+            rightCount[b] = sweepCount;
+            rightArea[b] = sweepCount ? SurfaceArea(sweepLower, sweepUpper) : 0.f;
+        }
+
+        // then from the left, picking the plane with the lowest SAH cost
+        float bestCost = LeafCost(count) * SurfaceArea(lower, upper);
+        int bestSplit = -1;
+        sweepCount = 0;
+        for (int b = 0; b < BinCount - 1; ++b)
+        {
+            if (binCounts[b] > 0)
+            {
+                sweepLower = sweepCount ? min(sweepLower, binLower[b]) : binLower[b];
+                sweepUpper = sweepCount ? max(sweepUpper, binUpper[b]) : binUpper[b];
+                sweepCount += binCounts[b];
+            }
+            if (sweepCount == 0 || rightCount[b + 1] == 0) continue;
+
+            float cost = TraversalCost * SurfaceArea(lower, upper) +
+                         LeafCost(sweepCount) * SurfaceArea(sweepLower, sweepUpper) +
+                         LeafCost(rightCount[b + 1]) * rightArea[b + 1];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestSplit = b;
+            }
+        }
+
+        if (bestSplit >= 0)
+        {
+            mid = int(partition(items.begin() + begin, items.begin() + end,
+                [&](const BuildItem &item) {
+                    int bin = std::min(BinCount - 1,
+                        int((item.centroid[axis] - centroidLower[axis]) * scale));
+                    return bin <= bestSplit;
+                }) - items.begin());
+        }
+        else if (count > MaxLeafSize)
+        {
+            // splitting never pays off by SAH, but huge leaves are worse
+            mid = begin + count / 2;
+            nth_element(items.begin() + begin, items.begin() + mid,
+                        items.begin() + end,
+                [&](const BuildItem &a, const BuildItem &b) {
+                    return a.centroid[axis] < b.centroid[axis];
+                });
+        }
+    }
+
+    if (mid == begin || mid == end)
+    {
+        // make a leaf out of this node
+        m_nodes[index].first = BuildLeaf(scene, items, begin, end);
+        m_nodes[index].count = count;
+        return index;
+    }
+
+    // left child lands right after this node, right child after that subtree
+    BuildNode(scene, items, begin, mid, depth + 1);
+    int right = BuildNode(scene, items, mid, end, depth + 1);
+    m_nodes[index].first = right;
+    m_nodes[index].count = 0;
+    return index;
+}
+
+// --------------------------------------------------------------------------
+
+int BVH::BuildLeaf(const sceneData &scene, const vector<BuildItem> &items,
+                   int begin, int end)
+{
+    Leaf leaf;
+    leaf.firstTriangleBlock = int(m_triangleBlocks.size());
+    leaf.firstSphereBlock = int(m_sphereBlocks.size());
+
+    int triangles = 0, spheres = 0;
+    for (int i = begin; i < end; ++i)
+    {
+        const primitiveRef &p = items[i].primitive;
+        if (p.type == SPHERE_PRIMITIVE)
+        {
+            if (spheres++ % BlockWidth == 0)
+            {
+                m_sphereBlocks.push_back(sphereBlock());
+                clearBlock(&m_sphereBlocks.back());
+            }
+            const preparedSphere &s = scene.preparedSpheres[p.index];
+            setLane(&m_sphereBlocks.back(), (spheres - 1) % BlockWidth,
+                    s.center, s.radiusSquared, p);
+            continue;
+        }
+
+        if (triangles++ % BlockWidth == 0)
+        {
+            m_triangleBlocks.push_back(triangleBlock());
+            clearBlock(&m_triangleBlocks.back());
+        }
+        int lane = (triangles - 1) % BlockWidth;
+        if (p.type == MESH_TRIANGLE_PRIMITIVE)
+        {
+            const unsigned int *index = &scene.meshIndices[3 * p.index];
+            setLane(&m_triangleBlocks.back(), lane, scene.meshVertices[index[0]],
+                    scene.meshVertices[index[1]], scene.meshVertices[index[2]], p);
+        }
+        else
+        {
+            const preparedTriangle &t = scene.preparedTriangles[p.index];
+            setLane(&m_triangleBlocks.back(), lane, t.P0, t.P1, t.P2, p);
+        }
+    }
+
+    leaf.triangleBlockCount = int(m_triangleBlocks.size()) - leaf.firstTriangleBlock;
+    leaf.sphereBlockCount = int(m_sphereBlocks.size()) - leaf.firstSphereBlock;
+    m_leaves.push_back(leaf);
+    return int(m_leaves.size()) - 1;
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,254 @@
+// ==========================================================================
+// Bounding Volume Hierarchy
+//  - accelerates ray queries against the bounded primitives of a scene
+//    (spheres, triangles and mesh triangles); unbounded planes are left to
+//    the caller
+//  - built once per scene with a binned surface area heuristic, stored as a
+//    flat depth-first array of nodes
+//  - the primitives of each leaf are packed into SIMD blocks, so a leaf is
+//    tested a block at a time rather than a primitive at a time
+//  - a packet of rays can walk the hierarchy together, each node's box being
+//    tested against all of the packet's rays at once
+// ==========================================================================
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "Scene.h"
+#include "PrimitiveBlocks.h"
+#include "RayPacket.h"
+#include "RenderStats.h"
+
+struct sceneData;
+
+// --------------------------------------------------------------------------
+// This class builds the hierarchy over spheres, triangles and mesh
+// triangles and walks it front-to-back for a ray, or for a packet of rays,
+// handing each candidate leaf to a visitor.
+
+class BVH
+{
+public:
+    // the blocks of one leaf: triangles and mesh triangles share the
+    // triangle blocks, spheres have their own
+    struct Leaf
+    {
+        int firstTriangleBlock, triangleBlockCount;
+        int firstSphereBlock, sphereBlockCount;
+    };
+
+private:
+    // axis-aligned box; leaves hold count primitives and first is their
+    // index in m_leaves, interior nodes have count == 0, their left child
+    // directly after them in the array and their right child at index first
+    struct Node
+    {
+        glm::vec3 lower, upper;
+        int first;
+        int count;
+    };
+
+    // bounds and centroid of one primitive while building
+    struct BuildItem
+    {
+        glm::vec3 lower, upper, centroid;
+        primitiveRef primitive;
+    };
+
+    std::vector<Node> m_nodes;
+    std::vector<Leaf> m_leaves;
+    std::vector<triangleBlock> m_triangleBlocks;
+    std::vector<sphereBlock> m_sphereBlocks;
+
+    int BuildNode(const sceneData &scene, std::vector<BuildItem> &items,
+                  int begin, int end, int depth);
+    int BuildLeaf(const sceneData &scene, const std::vector<BuildItem> &items,
+                  int begin, int end);
+
+    // slab test against [0, tMax]; returns the entry distance in *tEntry
+    static bool IntersectBox(const Node &node, const glm::vec3 &origin,
+                             const glm::vec3 &invDirection, float tMax,
+                             float *tEntry);
+
+public:
+    // leaves hold at most this many primitives unless they cannot be split
+    static const int MaxLeafSize = 2 * BlockWidth;
+
+    // (re)builds the hierarchy over the bounded primitives of scene
+    void Build(const sceneData &scene);
+
+    bool Empty() const      { return m_nodes.empty(); }
+    int NodeCount() const   { return int(m_nodes.size()); }
+    int LeafCount() const   { return int(m_leaves.size()); }
+
+    // the blocks the leaves index into; mesh triangles are copied into the
+    // triangle blocks with their vertices, so rays never read the mesh's
+    // index buffer, at the price of a block lane per triangle
+    const triangleBlock *TriangleBlocks() const { return m_triangleBlocks.data(); }
+    const sphereBlock *SphereBlocks() const     { return m_sphereBlocks.data(); }
+    int TriangleBlockCount() const  { return int(m_triangleBlocks.size()); }
+    int SphereBlockCount() const    { return int(m_sphereBlocks.size()); }
+
+    // visits the leaves whose boxes the ray enters before tMax, nearest
+    // boxes first. The visitor is called as visit(const Leaf &, tMax) and
+    // may lower tMax when it finds a closer hit, which prunes the rest of
+    // the walk; returning true from it stops the traversal immediately.
+    template <class Visitor>
+    void Traverse(const ray &r, float tMax, Visitor &visit) const;
+
+    // the same walk for the active rays of a packet at once: a node is
+    // entered if any of them passes through its box before its own
+    // tMax[lane], and the child some ray enters first is taken first. The
+    // visitor is called as visit(const Leaf &, packetMask rays, tMax) with
+    // the rays that reached the leaf, may lower their tMax, and returns the
+    // rays that are finished; the walk stops once every ray is.
+    template <class Visitor>
+    void TraversePacket(const rayPacket &packet, packetMask active, float *tMax,
+                        Visitor &visit) const;
+};
+
+// --------------------------------------------------------------------------
+
+inline bool BVH::IntersectBox(const Node &node, const glm::vec3 &origin,
+                              const glm::vec3 &invDirection, float tMax,
+                              float *tEntry)
+{
+    float tNear = 0.f, tFar = tMax;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float t0 = (node.lower[axis] - origin[axis]) * invDirection[axis];
+        float t1 = (node.upper[axis] - origin[axis]) * invDirection[axis];
+        if (t0 > t1) { float t = t0; t0 = t1; t1 = t; }
+        if (t0 > tNear) tNear = t0;
+        if (t1 < tFar)  tFar = t1;
+        if (tNear > tFar) return false;
+    }
+    *tEntry = tNear;
+    return true;
+}
+
+template <class Visitor>
+void BVH::Traverse(const ray &r, float tMax, Visitor &visit) const
+{
+    if (m_nodes.empty()) return;
+
+    glm::vec3 invDirection(1.f / r.direction.x, 1.f / r.direction.y,
+                           1.f / r.direction.z);
+
+    float tEntry;
+    if (!IntersectBox(m_nodes[0], r.origin, invDirection, tMax, &tEntry))
+        return;
+
+    // nodes on the stack have already passed their box test
+    int stack[64];
+    float stackEntry[64];
+    int top = 0;
+    stack[top] = 0;
+    stackEntry[top++] = tEntry;
+
+    while (top > 0)
+    {
+        --top;
+        if (stackEntry[top] > tMax) continue;   // a closer hit was found since
+        int index = stack[top];
+        const Node &node = m_nodes[index];
+        STAT_ADD(STAT_BVH_NODES, 1);
+
+        if (node.count > 0)
+        {
+            if (visit(m_leaves[node.first], tMax))
+                return;
+            continue;
+        }
+
+        // push the farther child first so the nearer one is visited next
+        int left = index + 1, right = node.first;
+        float tLeft = 0.f, tRight = 0.f;
+        bool hitLeft = IntersectBox(m_nodes[left], r.origin, invDirection, tMax, &tLeft);
+        bool hitRight = IntersectBox(m_nodes[right], r.origin, invDirection, tMax, &tRight);
+        if (hitLeft && hitRight)
+        {
+            bool leftFirst = tLeft <= tRight;
+            stack[top] = leftFirst ? right : left;
+            stackEntry[top++] = leftFirst ? tRight : tLeft;
+            stack[top] = leftFirst ? left : right;
+            stackEntry[top++] = leftFirst ? tLeft : tRight;
+        }
+        else if (hitLeft)
+        {
+            stack[top] = left;
+            stackEntry[top++] = tLeft;
+        }
+        else if (hitRight)
+        {
+            stack[top] = right;
+            stackEntry[top++] = tRight;
+        }
+    }
+}
+
+template <class Visitor>
+void BVH::TraversePacket(const rayPacket &packet, packetMask active, float *tMax,
+                         Visitor &visit) const
+{
+    if (m_nodes.empty() || active == 0) return;
+
+    float entry;
+    packetMask rays = packetBoxHits(packet, active, tMax, m_nodes[0].lower,
+                                    m_nodes[0].upper, &entry);
+    if (rays == 0) return;
+
+    // each node on the stack carries the rays that passed its box test
+    int stack[64];
+    packetMask stackRays[64];
+    int top = 0;
+    stack[top] = 0;
+    stackRays[top++] = rays;
+
+    while (top > 0)
+    {
+        --top;
+        int index = stack[top];
+        rays = stackRays[top] & active;     // less any finished since
+        if (rays == 0) continue;
+        const Node &node = m_nodes[index];
+        STAT_ADD(STAT_BVH_NODES, 1);
+
+        if (node.count > 0)
+        {
+            active &= ~visit(m_leaves[node.first], rays, tMax);
+            if (active == 0) return;
+            continue;
+        }
+
+        // push the farther child first so the nearer one is visited next
+        int left = index + 1, right = node.first;
+        float tLeft, tRight;
+        packetMask leftRays = packetBoxHits(packet, rays, tMax, m_nodes[left].lower,
+                                            m_nodes[left].upper, &tLeft);
+        packetMask rightRays = packetBoxHits(packet, rays, tMax, m_nodes[right].lower,
+                                             m_nodes[right].upper, &tRight);
+        bool leftFirst = tLeft <= tRight;
+        if (leftRays && rightRays)
+        {
+            stack[top] = leftFirst ? right : left;
+            stackRays[top++] = leftFirst ? rightRays : leftRays;
+            stack[top] = leftFirst ? left : right;
+            stackRays[top++] = leftFirst ? leftRays : rightRays;
+        }
+        else if (leftRays)
+        {
+            stack[top] = left;
+            stackRays[top++] = leftRays;
+        }
+        else if (rightRays)
+        {
+            stack[top] = right;
+            stackRays[top++] = rightRays;
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+#endif // BVH_H
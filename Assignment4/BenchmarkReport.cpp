@@ -0,0 +1,121 @@
+// ==========================================================================
+// Benchmark Reports
+// ==========================================================================
+
+#include "BenchmarkReport.h"
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+// --------------------------------------------------------------------------
+
+namespace
+{
+    // names and values here are plain text, but a scene file name could
+    // still hold a quote or backslash
+    string jsonString(const string &text)
+    {
+        string quoted = "\"";
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            char c = text[i];
+            if (c == '"' || c == '\\')
+                quoted += '\\';
+            if ((unsigned char)c < 0x20)
+                c = ' ';
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+
+    double nsPerOperation(const benchmarkResult &result)
+    {
+        return result.operations > 0 ? result.seconds / result.operations * 1.0e9 : 0.0;
+    }
+
+    double operationsPerSecond(const benchmarkResult &result)
+    {
+        return result.seconds > 0 ? result.operations / result.seconds : 0.0;
+    }
+}
+
+// --------------------------------------------------------------------------
+
+void BenchmarkReport::SetContext(const string &key, const string &value)
+{
+    for (size_t i = 0; i < m_context.size(); ++i)
+        if (m_context[i].first == key)
+        {
+            m_context[i].second = value;
+            return;
+        }
+    m_context.push_back(make_pair(key, value));
+}
+
+void BenchmarkReport::Add(const benchmarkResult &result)
+{
+    m_results.push_back(result);
+}
+
+// --------------------------------------------------------------------------
+
+void BenchmarkReport::WriteCsv(ostream &out) const
+{
+    for (size_t i = 0; i < m_context.size(); ++i)
+        out << m_context[i].first << ",";
+    out << "group,name,size,unit,operations,ms,ns_per_op,ops_per_s" << endl;
+
+    for (size_t r = 0; r < m_results.size(); ++r)
+    {
+        const benchmarkResult &result = m_results[r];
+        for (size_t i = 0; i < m_context.size(); ++i)
+            out << m_context[i].second << ",";
+        out << result.group << "," << result.name << "," << result.size << ","
+            << result.unit << "," << result.operations << "," << result.seconds * 1000.0 << ","
+            << nsPerOperation(result) << "," << operationsPerSecond(result) << endl;
+    }
+}
+
+void BenchmarkReport::WriteJson(ostream &out) const
+{
+    out << "{\n  \"context\": {";
+    for (size_t i = 0; i < m_context.size(); ++i)
+        out << (i ? ", " : " ") << jsonString(m_context[i].first) << ": "
+            << jsonString(m_context[i].second);
+    out << " },\n  \"results\": [";
+
+    for (size_t r = 0; r < m_results.size(); ++r)
+    {
+        const benchmarkResult &result = m_results[r];
+        out << (r ? ",\n" : "\n") << "    { \"group\": " << jsonString(result.group)
+            << ", \"name\": " << jsonString(result.name)
+            << ", \"size\": " << result.size
+            << ", \"unit\": " << jsonString(result.unit)
+            << ", \"operations\": " << result.operations
+            << ", \"ms\": " << result.seconds * 1000.0
+            << ", \"ns_per_op\": " << nsPerOperation(result)
+            << ", \"ops_per_s\": " << operationsPerSecond(result) << " }";
+    }
+    out << "\n  ]\n}" << endl;
+}
+
+bool BenchmarkReport::Save(const string &fileName) const
+{
+    ofstream file(fileName);
+    if (!file)
+    {
+        cout << "BenchmarkReport ERROR: Could not open " << fileName << endl;
+        return false;
+    }
+    file.precision(9);
+
+    bool json = fileName.size() > 5 && fileName.compare(fileName.size() - 5, 5, ".json") == 0;
+    if (json)
+        WriteJson(file);
+    else
+        WriteCsv(file);
+    return bool(file);
+}
+
+// --------------------------------------------------------------------------
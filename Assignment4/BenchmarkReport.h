@@ -0,0 +1,47 @@
+// ==========================================================================
+// Benchmark Reports
+//  - collects the timings of a benchmark run together with what it ran on
+//    (instruction set, threads, image size, ...) and writes them as CSV or
+//    JSON, so that runs of different builds can be compared by a script
+// ==========================================================================
+#ifndef BENCHMARKREPORT_H
+#define BENCHMARKREPORT_H
+
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <vector>
+
+// one measurement: the best of some repeats of a fixed amount of work
+struct benchmarkResult
+{
+    std::string group;      // "micro" for one function, "frame" for a render
+    std::string name;       // what ran, e.g. "intersectSphere" or "scene1.txt"
+    long long size;         // primitives in the scene it ran on, if any
+    std::string unit;       // what an operation is: "test", "ray", ...
+    double operations;      // operations in one repeat
+    double seconds;         // time of the fastest repeat
+};
+
+class BenchmarkReport
+{
+    std::vector<std::pair<std::string, std::string> > m_context;
+    std::vector<benchmarkResult> m_results;
+
+public:
+    // describes the run as a whole; written once, ahead of the results
+    void SetContext(const std::string &key, const std::string &value);
+
+    void Add(const benchmarkResult &result);
+
+    // one row per result, with ns per operation and operations per second
+    // worked out; CSV puts the context in columns on every row
+    void WriteCsv(std::ostream &out) const;
+    void WriteJson(std::ostream &out) const;
+
+    // writes JSON if fileName ends in .json and CSV otherwise
+    bool Save(const std::string &fileName) const;
+};
+
+// --------------------------------------------------------------------------
+#endif // BENCHMARKREPORT_H
@@ -0,0 +1,296 @@
+// ==========================================================================
+// Binary Scene Format
+// ==========================================================================
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include "BinaryScene.h"
+
+using namespace std;
+using namespace glm;
+
+// --------------------------------------------------------------------------
+
+namespace
+{
+    const int ColumnCount[SECTION_COUNT] = { 4, 7, 9, 12, 3, 1, 5 };
+
+    unsigned long long alignUp(unsigned long long bytes)
+    {
+        return (bytes + BinarySceneAlignment - 1) / BinarySceneAlignment * BinarySceneAlignment;
+    }
+
+    // bytes from the start of one column of a section to the next
+    unsigned long long columnStride(unsigned long long count)
+    {
+        return alignUp(count * sizeof(float));
+    }
+
+    // the columns of one section of a mapped file, once checked to fit
+    struct columns
+    {
+        const char *base;
+        unsigned long long stride;
+
+        const float *operator[](int column) const
+        {
+            return reinterpret_cast<const float *>(base + column * stride);
+        }
+
+        const unsigned int *Integers(int column) const
+        {
+            return reinterpret_cast<const unsigned int *>(base + column * stride);
+        }
+    };
+
+    // writes one column of a section, padded up to the next column
+    template<class Value, class Record, class Field>
+    void writeTypedColumn(ofstream &file, const vector<Record> &records, Field field)
+    {
+        vector<Value> column(records.size());
+        for (size_t i = 0; i < records.size(); ++i)
+            column[i] = field(records[i]);
+
+        static const char padding[BinarySceneAlignment] = { 0 };
+        if (!column.empty())
+            file.write(reinterpret_cast<const char *>(&column[0]), column.size() * sizeof(Value));
+        file.write(padding, columnStride(records.size()) - column.size() * sizeof(Value));
+    }
+
+    template<class Record, class Field>
+    void writeColumn(ofstream &file, const vector<Record> &records, Field field)
+    {
+        writeTypedColumn<float>(file, records, field);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+bool isBinaryScene(const char *data, size_t size)
+{
+    return size >= sizeof(BinarySceneMagic) &&
+           memcmp(data, BinarySceneMagic, sizeof(BinarySceneMagic)) == 0;
+}
+
+bool readBinaryScene(const char *data, size_t size, const string &name,
+                     sceneData *scene)
+{
+    // the header grows with the version, so check that first
+    binarySceneHeader header;
+    size_t versionEnd = offsetof(binarySceneHeader, count);
+    if (size < versionEnd || !isBinaryScene(data, size))
+    {
+        cout << "ERROR: " << name << " is not a binary scene" << endl;
+        return false;
+    }
+    memcpy(&header, data, versionEnd);
+    if (header.version != BinarySceneVersion || header.byteOrder != BinarySceneByteOrder)
+    {
+        cout << "ERROR: " << name << " is binary scene version " << header.version
+             << " or from a machine of another byte order; convert it again" << endl;
+        return false;
+    }
+    if (size < sizeof(header))
+    {
+        cout << "ERROR: " << name << " is truncated or corrupt" << endl;
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    // check every section lies inside the file before touching any of it
+    columns section[SECTION_COUNT];
+    for (int s = 0; s < SECTION_COUNT; ++s)
+    {
+        unsigned long long stride = columnStride(header.count[s]);
+        if (header.count[s] > size || header.offset[s] % BinarySceneAlignment != 0 ||
+            header.offset[s] > size || stride * ColumnCount[s] > size - header.offset[s])
+        {
+            cout << "ERROR: " << name << " is truncated or corrupt" << endl;
+            return false;
+        }
+        section[s].base = data + header.offset[s];
+        section[s].stride = stride;
+    }
+
+    const columns &l = section[LIGHT_SECTION];
+    scene->lights.resize(size_t(header.count[LIGHT_SECTION]));
+    for (size_t i = 0; i < scene->lights.size(); ++i)
+    {
+        scene->lights[i].position = vec3(l[0][i], l[1][i], l[2][i]);
+        scene->lights[i].intensity = l[3][i];
+    }
+
+    const columns &s = section[SPHERE_SECTION];
+    scene->preparedSpheres.resize(size_t(header.count[SPHERE_SECTION]));
+    for (size_t i = 0; i < scene->preparedSpheres.size(); ++i)
+    {
+        sphere record;
+        record.center = vec3(s[0][i], s[1][i], s[2][i]);
+        record.radius = s[3][i];
+        record.color = vec3(s[4][i], s[5][i], s[6][i]);
+        scene->preparedSpheres[i] = prepareSphere(record);
+    }
+
+    const columns &p = section[PLANE_SECTION];
+    scene->preparedPlanes.resize(size_t(header.count[PLANE_SECTION]));
+    for (size_t i = 0; i < scene->preparedPlanes.size(); ++i)
+    {
+        plane record;
+        record.normal = vec3(p[0][i], p[1][i], p[2][i]);
+        record.position = vec3(p[3][i], p[4][i], p[5][i]);
+        record.color = vec3(p[6][i], p[7][i], p[8][i]);
+        scene->preparedPlanes[i] = preparePlane(record);
+    }
+
+    const columns &t = section[TRIANGLE_SECTION];
+    scene->preparedTriangles.resize(size_t(header.count[TRIANGLE_SECTION]));
+    for (size_t i = 0; i < scene->preparedTriangles.size(); ++i)
+    {
+        triangle record;
+        record.P0 = vec3(t[0][i], t[1][i], t[2][i]);
+        record.P1 = vec3(t[3][i], t[4][i], t[5][i]);
+        record.P2 = vec3(t[6][i], t[7][i], t[8][i]);
+        record.color = vec3(t[9][i], t[10][i], t[11][i]);
+        scene->preparedTriangles[i] = prepareTriangle(record);
+    }
+
+    const columns &v = section[MESH_VERTEX_SECTION];
+    scene->meshVertices.resize(size_t(header.count[MESH_VERTEX_SECTION]));
+    for (size_t i = 0; i < scene->meshVertices.size(); ++i)
+        scene->meshVertices[i] = vec3(v[0][i], v[1][i], v[2][i]);
+
+    // indices are used unchecked by the tracer, so check them all here
+    const unsigned int *indices = section[MESH_INDEX_SECTION].Integers(0);
+    scene->meshIndices.assign(indices, indices + header.count[MESH_INDEX_SECTION]);
+    for (size_t i = 0; i < scene->meshIndices.size(); ++i)
+    {
+        if (scene->meshIndices[i] >= scene->meshVertices.size())
+        {
+            cout << "ERROR: " << name << " has a mesh index out of range" << endl;
+            return false;
+        }
+    }
+
+    const columns &m = section[MESH_SECTION];
+    scene->meshes.resize(size_t(header.count[MESH_SECTION]));
+    size_t meshTriangles = scene->meshIndices.size() / 3;
+    unsigned int nextTriangle = 0;
+    for (size_t i = 0; i < scene->meshes.size(); ++i)
+    {
+        mesh &record = scene->meshes[i];
+        unsigned int first = m.Integers(0)[i], count = m.Integers(1)[i];
+        if (first != nextTriangle || count > meshTriangles - first)
+        {
+            cout << "ERROR: " << name << " has a mesh out of order, out of range or after a gap" << endl;
+            return false;
+        }
+        nextTriangle = first + count;
+        record.firstTriangle = int(first);
+        record.triangleCount = int(count);
+        record.color = vec3(m[2][i], m[3][i], m[4][i]);
+    }
+
+    // the tracer looks up the mesh of every triangle, so every one needs one
+    if (nextTriangle != meshTriangles)
+    {
+        cout << "ERROR: " << name << " has mesh triangles that belong to no mesh" << endl;
+        return false;
+    }
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+bool writeBinaryScene(const string &filename, const sceneData &scene)
+{
+    ofstream file(filename.c_str(), ios::binary);
+    if (!file)
+    {
+        cout << "ERROR: Could not write binary scene " << filename << endl;
+        return false;
+    }
+
+    binarySceneHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BinarySceneMagic, sizeof(BinarySceneMagic));
+    header.version = BinarySceneVersion;
+    header.byteOrder = BinarySceneByteOrder;
+    header.count[LIGHT_SECTION] = scene.lights.size();
+    header.count[SPHERE_SECTION] = scene.spheres.size();
+    header.count[PLANE_SECTION] = scene.planes.size();
+    header.count[TRIANGLE_SECTION] = scene.triangles.size();
+    header.count[MESH_VERTEX_SECTION] = scene.meshVertices.size();
+    header.count[MESH_INDEX_SECTION] = scene.meshIndices.size();
+    header.count[MESH_SECTION] = scene.meshes.size();
+
+    unsigned long long offset = alignUp(sizeof(header));
+    for (int s = 0; s < SECTION_COUNT; ++s)
+    {
+        header.offset[s] = offset;
+        offset += columnStride(header.count[s]) * ColumnCount[s];
+    }
+
+    static const char padding[BinarySceneAlignment] = { 0 };
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(padding, alignUp(sizeof(header)) - sizeof(header));
+
+    const vector<light> &l = scene.lights;
+    writeColumn(file, l, [](const light &r) { return r.position.x; });
+    writeColumn(file, l, [](const light &r) { return r.position.y; });
+    writeColumn(file, l, [](const light &r) { return r.position.z; });
+    writeColumn(file, l, [](const light &r) { return r.intensity; });
+
+    const vector<sphere> &s = scene.spheres;
+    writeColumn(file, s, [](const sphere &r) { return r.center.x; });
+    writeColumn(file, s, [](const sphere &r) { return r.center.y; });
+    writeColumn(file, s, [](const sphere &r) { return r.center.z; });
+    writeColumn(file, s, [](const sphere &r) { return r.radius; });
+    writeColumn(file, s, [](const sphere &r) { return r.color.x; });
+    writeColumn(file, s, [](const sphere &r) { return r.color.y; });
+    writeColumn(file, s, [](const sphere &r) { return r.color.z; });
+
+    const vector<plane> &p = scene.planes;
+    writeColumn(file, p, [](const plane &r) { return r.normal.x; });
+    writeColumn(file, p, [](const plane &r) { return r.normal.y; });
+    writeColumn(file, p, [](const plane &r) { return r.normal.z; });
+    writeColumn(file, p, [](const plane &r) { return r.position.x; });
+    writeColumn(file, p, [](const plane &r) { return r.position.y; });
+    writeColumn(file, p, [](const plane &r) { return r.position.z; });
+    writeColumn(file, p, [](const plane &r) { return r.color.x; });
+    writeColumn(file, p, [](const plane &r) { return r.color.y; });
+    writeColumn(file, p, [](const plane &r) { return r.color.z; });
+
+    const vector<triangle> &t = scene.triangles;
+    writeColumn(file, t, [](const triangle &r) { return r.P0.x; });
+    writeColumn(file, t, [](const triangle &r) { return r.P0.y; });
+    writeColumn(file, t, [](const triangle &r) { return r.P0.z; });
+    writeColumn(file, t, [](const triangle &r) { return r.P1.x; });
+    writeColumn(file, t, [](const triangle &r) { return r.P1.y; });
+    writeColumn(file, t, [](const triangle &r) { return r.P1.z; });
+    writeColumn(file, t, [](const triangle &r) { return r.P2.x; });
+    writeColumn(file, t, [](const triangle &r) { return r.P2.y; });
+    writeColumn(file, t, [](const triangle &r) { return r.P2.z; });
+    writeColumn(file, t, [](const triangle &r) { return r.color.x; });
+    writeColumn(file, t, [](const triangle &r) { return r.color.y; });
+    writeColumn(file, t, [](const triangle &r) { return r.color.z; });
+
+    const vector<vec3> &v = scene.meshVertices;
+    writeColumn(file, v, [](const vec3 &r) { return r.x; });
+    writeColumn(file, v, [](const vec3 &r) { return r.y; });
+    writeColumn(file, v, [](const vec3 &r) { return r.z; });
+
+    writeTypedColumn<unsigned int>(file, scene.meshIndices, [](unsigned int r) { return r; });
+
+    const vector<mesh> &m = scene.meshes;
+    writeTypedColumn<unsigned int>(file, m, [](const mesh &r) { return (unsigned int)(r.firstTriangle); });
+    writeTypedColumn<unsigned int>(file, m, [](const mesh &r) { return (unsigned int)(r.triangleCount); });
+    writeColumn(file, m, [](const mesh &r) { return r.color.x; });
+    writeColumn(file, m, [](const mesh &r) { return r.color.y; });
+    writeColumn(file, m, [](const mesh &r) { return r.color.z; });
+
+    return bool(file);
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,74 @@
+// ==========================================================================
+// Binary Scene Format
+//  - a versioned file holding a scene as packed structure-of-arrays
+//    columns, written once by a converter and then memory-mapped and read
+//    in place on every load, with no text to tokenize or numbers to parse
+// ==========================================================================
+#ifndef BINARYSCENE_H
+#define BINARYSCENE_H
+
+#include <cstddef>
+#include <string>
+#include "SceneCache.h"
+
+// --------------------------------------------------------------------------
+// File layout (little-endian):
+//
+//   binarySceneHeader
+//   light section:     x, y, z, intensity
+//   sphere section:    centre x, y, z, radius, r, g, b
+//   plane section:     normal x, y, z, position x, y, z, r, g, b
+//   triangle section:  P0 x, y, z, P1 x, y, z, P2 x, y, z, r, g, b
+//   mesh vertices:     x, y, z
+//   mesh indices:      index (three per triangle)
+//   meshes:            first triangle, triangle count, r, g, b
+//
+// Each section is the listed columns back to back, one 4-byte value per
+// object in every column: unsigned ints for indices, first triangle and
+// triangle count, floats for everything else. Sections and columns start on
+// BinarySceneAlignment byte boundaries, so a mapped file can be read with
+// aligned loads.
+
+const char BinarySceneMagic[8] = { 'A', '4', 'S', 'C', 'E', 'N', 'E', '\n' };
+const unsigned int BinarySceneVersion = 2;
+const unsigned int BinarySceneByteOrder = 0x01020304;
+const unsigned int BinarySceneAlignment = 64;
+
+enum BinarySceneSection
+{
+    LIGHT_SECTION,
+    SPHERE_SECTION,
+    PLANE_SECTION,
+    TRIANGLE_SECTION,
+    MESH_VERTEX_SECTION,
+    MESH_INDEX_SECTION,
+    MESH_SECTION,
+    SECTION_COUNT
+};
+
+struct binarySceneHeader
+{
+    char magic[8];
+    unsigned int version;
+    unsigned int byteOrder;             // BinarySceneByteOrder as written
+    unsigned long long count[SECTION_COUNT];
+    unsigned long long offset[SECTION_COUNT];   // from the start of the file
+};
+
+// true if the bytes start with the binary scene magic number
+bool isBinaryScene(const char *data, size_t size);
+
+// reads a mapped binary scene into scene: the lights and meshes are copied
+// and the prepared forms are computed straight from the mapped columns,
+// leaving the sphere, plane and triangle records empty. Returns false, after
+// printing why, if the file is truncated, inconsistent, or from another
+// version or byte order.
+bool readBinaryScene(const char *data, size_t size, const std::string &name,
+                     sceneData *scene);
+
+// writes the records and meshes of scene (not its prepared forms) as a
+// binary scene
+bool writeBinaryScene(const std::string &filename, const sceneData &scene);
+
+// --------------------------------------------------------------------------
+#endif // BINARYSCENE_H
@@ -16,6 +16,11 @@
 // ==========================================================================
 
 #include "imagebuffer.h"
+#include "ImageWriter.h"
+#include "KernelDispatch.h"
+#include "RenderStats.h"
+#include "TraceRecorder.h"
+#include <algorithm>
 #include <iostream>
 #include <glm/common.hpp>
 #include <string>
@@ -40,10 +45,14 @@ using namespace glm;
 
 // --------------------------------------------------------------------------
 
-ImageBuffer::ImageBuffer()
+ImageBuffer::ImageBuffer(PixelLayout layout, PixelFormat format)
     : m_textureName(0), m_framebufferObject(0),
-      m_width(0), m_height(0), m_modified(false)
+      m_width(0), m_height(0), m_layout(layout), m_format(format),
+      m_pixelBytes(pixelFormatBytes(format)), m_tilesX(0), m_tilesY(0),
+      m_dirtyWords(0)
 {
+    colorEncoding linear = { false, false, false };
+    m_encoding = linear;
 }
 
 ImageBuffer::~ImageBuffer()
@@ -52,11 +61,80 @@ ImageBuffer::~ImageBuffer()
     if (m_textureName)          glDeleteTextures(1, &m_textureName);
 }
 
+void ImageBuffer::MarkDirty(int tileX, int tileY)
+{
+    int tile = tileY * m_tilesX + tileX;
+    m_dirtyTiles[tile / 64].fetch_or(DirtyWord(1) << (tile % 64), memory_order_release);
+}
+
 void ImageBuffer::ResetModified()
 {
-    m_modified = false;
-    m_modifiedLower = m_height;
-    m_modifiedUpper = 0;
+    for (int i = 0; i < m_dirtyWords; ++i)
+        m_dirtyTiles[i].store(0, memory_order_relaxed);
+}
+
+// --------------------------------------------------------------------------
+
+void ImageBuffer::AllocateImage(int width, int height)
+{
+    m_width = width;
+    m_height = height;
+
+    m_tilesX = (m_width + ImageTileWidth - 1) / ImageTileWidth;
+    m_tilesY = (m_height + ImageTileWidth - 1) / ImageTileWidth;
+
+    size_t pixels = size_t(m_width) * m_height;
+    if (m_layout == TILED_LAYOUT)
+        pixels = size_t(m_tilesX) * m_tilesY * ImageTileWidth * ImageTileWidth;
+    m_imageData.resize(pixels * m_pixelBytes);
+
+    m_dirtyWords = (m_tilesX * m_tilesY + 63) / 64;
+    m_dirtyTiles.reset(new atomic<DirtyWord>[m_dirtyWords]);
+    for (int i = 0; i < m_height; ++i)
+        for (int j = 0; j < m_width; ++j)
+        {
+            int p = (i >> 4) + (j >> 4);
+            vec3 c = vec3(0.2 + ((p & 1) ? 0.1 : 0.0));
+            packPixels(m_format, &c, 1, PixelData(j, i));
+        }
+}
+
+const vec3 *ImageBuffer::LinearRows(int lower, int upper)
+{
+    m_uploadRows.resize((upper - lower) * m_width);
+    ReadTile(0, lower, m_width, upper - lower, &m_uploadRows[0]);
+    return &m_uploadRows[0];
+}
+
+const unsigned char *ImageBuffer::EncodeTexels(int x0, int y0, int w, int h)
+{
+    // a row at a time through the encoding kernel, then spread out to
+    // RGBA with opaque alpha
+    m_uploadRows.resize(w);
+    m_encodedRow.resize(w * 3);
+    m_uploadBytes.resize(w * h * 4);
+    unsigned char *out = &m_uploadBytes[0];
+    for (int y = y0; y < y0 + h; ++y)
+    {
+        ReadTile(x0, y, w, 1, &m_uploadRows[0]);
+        activeKernels.encodeRow(&m_uploadRows[0].x, w, y, m_encoding, &m_encodedRow[0]);
+        const unsigned char *rgb = &m_encodedRow[0];
+        for (int x = 0; x < w; ++x, rgb += 3, out += 4)
+        {
+            out[0] = rgb[0];
+            out[1] = rgb[1];
+            out[2] = rgb[2];
+            out[3] = 255;
+        }
+    }
+    return &m_uploadBytes[0];
+}
+
+void ImageBuffer::SetEncoding(const colorEncoding &encoding)
+{
+    m_encoding = encoding;
+    for (int i = 0; i < m_dirtyWords; ++i)
+        m_dirtyTiles[i].store(~DirtyWord(0), memory_order_relaxed);
 }
 
 // --------------------------------------------------------------------------
@@ -66,25 +144,16 @@ bool ImageBuffer::Initialize()
     // retrieve the current viewport size
     GLint viewport[4];
     glGetIntegerv(GL_VIEWPORT, viewport);
-    m_width = viewport[2];
-    m_height = viewport[3];
 
     // allocate image data
-    m_imageData.resize(m_width * m_height);
-    for (int i = 0, k = 0; i < m_height; ++i)
-        for (int j = 0; j < m_width; ++j, ++k)
-        {
-            int p = (i >> 4) + (j >> 4);
-            float c = 0.2 + ((p & 1) ? 0.1 : 0.0);
-            m_imageData[k] = vec3(c);
-        }
+    AllocateImage(viewport[2], viewport[3]);
 
     // allocate texture object
     if (!m_textureName)
         glGenTextures(1, &m_textureName);
     glBindTexture(GL_TEXTURE_RECTANGLE, m_textureName);
-    glTexImage2D(GL_TEXTURE_RECTANGLE, 0, GL_RGB, m_width, m_height, 0, GL_RGB,
-                 GL_FLOAT, &m_imageData[0]);
+    glTexImage2D(GL_TEXTURE_RECTANGLE, 0, GL_RGBA8, m_width, m_height, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, EncodeTexels(0, 0, m_width, m_height));
     glBindTexture(GL_TEXTURE_RECTANGLE, 0);
     ResetModified();
 
@@ -104,17 +173,67 @@ bool ImageBuffer::Initialize()
     return status == GL_FRAMEBUFFER_COMPLETE;
 }
 
+bool ImageBuffer::Initialize(int width, int height)
+{
+    if (width <= 0 || height <= 0)
+    {
+        cout << "ImageBuffer ERROR: Invalid image size " << width << "x"
+             << height << "!" << endl;
+        return false;
+    }
+
+    // no texture or framebuffer object here, so Render() becomes a no-op
+    AllocateImage(width, height);
+    ResetModified();
+    return true;
+}
+
 // --------------------------------------------------------------------------
 
 void ImageBuffer::SetPixel(int x, int y, vec3 colour)
 {
-    int index = y * m_width + x;
-    m_imageData[index] = colour;
+    packPixels(m_format, &colour, 1, PixelData(x, y));
+
+    // mark that something was changed; the or is skipped if the tile is
+    // already marked, so threads mostly just read the shared word
+    int tile = (y / ImageTileWidth) * m_tilesX + x / ImageTileWidth;
+    DirtyWord bit = DirtyWord(1) << (tile % 64);
+    if (!(m_dirtyTiles[tile / 64].load(memory_order_relaxed) & bit))
+        m_dirtyTiles[tile / 64].fetch_or(bit, memory_order_release);
+}
+
+void ImageBuffer::WriteTile(int x0, int y0, int w, int h, const vec3 *pixels)
+{
+    // copy runs that stay within one tile row (or image row, if linear)
+    for (int y = y0; y < y0 + h; ++y)
+        for (int x = x0; x < x0 + w; )
+        {
+            int count = x0 + w - x;
+            if (m_layout == TILED_LAYOUT)
+                count = std::min(count, ImageTileWidth - x % ImageTileWidth);
+            packPixels(m_format, pixels, count, PixelData(x, y));
+            pixels += count;
+            x += count;
+        }
 
-    // mark that something was changed
-    m_modified = true;
-    m_modifiedLower = min(m_modifiedLower, y);
-    m_modifiedUpper = max(m_modifiedUpper, y+1);
+    // the release in MarkDirty() publishes the pixels above along with it
+    for (int ty = y0 / ImageTileWidth; ty <= (y0 + h - 1) / ImageTileWidth; ++ty)
+        for (int tx = x0 / ImageTileWidth; tx <= (x0 + w - 1) / ImageTileWidth; ++tx)
+            MarkDirty(tx, ty);
+}
+
+void ImageBuffer::ReadTile(int x0, int y0, int w, int h, vec3 *pixels) const
+{
+    for (int y = y0; y < y0 + h; ++y)
+        for (int x = x0; x < x0 + w; )
+        {
+            int count = x0 + w - x;
+            if (m_layout == TILED_LAYOUT)
+                count = std::min(count, ImageTileWidth - x % ImageTileWidth);
+            unpackPixels(m_format, PixelData(x, y), count, pixels);
+            pixels += count;
+            x += count;
+        }
 }
 
 // --------------------------------------------------------------------------
@@ -122,22 +241,39 @@ void ImageBuffer::SetPixel(int x, int y, vec3 colour)
 void ImageBuffer::Render()
 {
     if (!m_framebufferObject) return;
+    STAT_TIMER(PHASE_UPLOAD);
+    TRACE_SCOPE("ImageBuffer::Render");
 
-    // check for modifications to the image data and update texture as needed
-    if (m_modified)
-    {
-        int sizeY = m_modifiedUpper - m_modifiedLower;
-        int index = m_modifiedLower * m_width;
+    // take the tiles marked since the last call; every WriteTile() has
+    // returned by now (see ImageBuffer.h), and the acquire pairs with the
+    // release of its mark, making its pixels visible here
+    m_takenTiles.resize(m_dirtyWords);
+    for (int i = 0; i < m_dirtyWords; ++i)
+        m_takenTiles[i] = m_dirtyTiles[i].exchange(0, memory_order_acquire);
 
-        // bind texture and copy only the rows that have been changed
-        glBindTexture(GL_TEXTURE_RECTANGLE, m_textureName);
-        glTexSubImage2D(GL_TEXTURE_RECTANGLE, 0, 0, m_modifiedLower, m_width,
-                        sizeY, GL_RGB, GL_FLOAT, &m_imageData[index]);
-        glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+    glBindTexture(GL_TEXTURE_RECTANGLE, m_textureName);
+    for (int ty = 0; ty < m_tilesY; ++ty)
+    {
+        // upload each band of tiles from its first to its last dirty tile
+        int first = m_tilesX, last = -1;
+        for (int tx = 0; tx < m_tilesX; ++tx)
+        {
+            int tile = ty * m_tilesX + tx;
+            if (m_takenTiles[tile / 64] >> (tile % 64) & 1)
+            {
+                first = std::min(first, tx);
+                last = tx;
+            }
+        }
+        if (last < 0) continue;
 
-        // mark that we've updated the texture
-        ResetModified();
+        int x0 = first * ImageTileWidth, y0 = ty * ImageTileWidth;
+        int sizeX = std::min((last + 1) * ImageTileWidth, m_width) - x0;
+        int sizeY = std::min(y0 + ImageTileWidth, m_height) - y0;
+        glTexSubImage2D(GL_TEXTURE_RECTANGLE, 0, x0, y0, sizeX, sizeY, GL_RGBA,
+                        GL_UNSIGNED_BYTE, EncodeTexels(x0, y0, sizeX, sizeY));
     }
+    glBindTexture(GL_TEXTURE_RECTANGLE, 0);
 
     // bind the framebuffer object with our texture in it and copy to screen
     glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebufferObject);
@@ -156,24 +292,35 @@ bool ImageBuffer::SaveToFile(const string &imageFileName)
         cout << "ImageBuffer ERROR: Trying to save uninitialized image!" << endl;
         return false;
     }
+    STAT_TIMER(PHASE_SAVE);
+    TRACE_SCOPE("ImageBuffer::SaveToFile");
     cout << "ImageBuffer saving image to " << imageFileName << "..." << endl;
 
+    // pairs with the release in every WriteTile() that already returned
+    for (int i = 0; i < m_dirtyWords; ++i)
+        m_dirtyTiles[i].load(memory_order_acquire);
+
+    // PPM, PFM and PNG need no image library, so they work on any
+    // (headless) host; rows are streamed out as they are converted
+    ImageFileFormat format;
+    if (imageFileFormat(imageFileName, &format))
+    {
+        return writeImage(imageFileName, format, m_width, m_height,
+                          [this](int y) { return LinearRows(y, y+1); }, m_encoding);
+    }
+
 #ifdef USE_IMAGEMAGICK
     using namespace Magick;
 
-    // allocate an image object the same size as our buffer
-    Image myImage(Geometry(m_width, m_height), "black");
-
-    // copy the image data from our memory buffer into the Magick++ one.
-    int index = 0;
-    for (int i = m_height-1; i >= 0; --i)
-        for (int j = 0; j < m_width; ++j)
-        {
-            vec3 v = m_imageData[index++];
-            vec3 c = clamp(v, 0.f, 1.f) * float(MaxRGB);
-            Color colour(c.r, c.g, c.b);
-            myImage.pixelColor(j, i, colour);
-        }
+    // Magick++ takes the whole image at once, with the top row first
+    vector<unsigned char> bytes(m_width * m_height * 3);
+    for (int i = 0; i < m_height; ++i)
+    {
+        int y = m_height-1 - i;
+        activeKernels.encodeRow(&LinearRows(y, y+1)->x, m_width, y, m_encoding,
+                                &bytes[i * m_width * 3]);
+    }
+    Image myImage(m_width, m_height, "RGB", CharPixel, &bytes[0]);
 
     // try to write the image to the specified file
     try {
@@ -187,6 +334,35 @@ bool ImageBuffer::SaveToFile(const string &imageFileName)
     return true;
 #endif
 
+#ifdef USE_FREEIMAGE
+    FREE_IMAGE_FORMAT fif = FreeImage_GetFIFFromFilename(imageFileName.c_str());
+    if (fif == FIF_UNKNOWN || !FreeImage_FIFSupportsWriting(fif))
+    {
+        cout << "ImageBuffer ERROR: No way to write " << imageFileName << endl;
+        return false;
+    }
+
+    // FreeImage scanlines run bottom to top, like ours
+    FIBITMAP *bitmap = FreeImage_Allocate(m_width, m_height, 24);
+    vector<unsigned char> bytes(m_width * 3);
+    for (int i = 0; i < m_height; ++i)
+    {
+        activeKernels.encodeRow(&LinearRows(i, i+1)->x, m_width, i, m_encoding, &bytes[0]);
+        BYTE *scanline = FreeImage_GetScanLine(bitmap, i);
+        for (int j = 0; j < m_width; ++j, scanline += 3)
+        {
+            scanline[FI_RGBA_RED] = bytes[j*3];
+            scanline[FI_RGBA_GREEN] = bytes[j*3 + 1];
+            scanline[FI_RGBA_BLUE] = bytes[j*3 + 2];
+        }
+    }
+    bool saved = FreeImage_Save(fif, bitmap, imageFileName.c_str()) != 0;
+    FreeImage_Unload(bitmap);
+    if (!saved)
+        cout << "FreeImage failed to write image " << imageFileName << endl;
+    return saved;
+#endif
+
     return false;
 }
 
@@ -14,7 +14,11 @@
 #define IMAGEBUFFER_H
 
 #include <vector>
+#include <atomic>
+#include <memory>
 #include <glm/vec3.hpp>
+#include "KernelDispatch.h"
+#include "PixelFormat.h"
 
 #ifndef GLFW_VERSION_MAJOR
 #define GLFW_INCLUDE_GLCOREARB
@@ -23,6 +27,20 @@
 #include <GLFW/glfw3.h>
 #endif
 
+// --------------------------------------------------------------------------
+// How the pixels are laid out in memory. Tiled keeps each ImageTileWidth x
+// ImageTileWidth block of pixels together, so a render tile or packet writes
+// a few contiguous runs instead of one short run per image row; it is turned
+// into rows only when the image is uploaded or saved.
+
+enum PixelLayout
+{
+    LINEAR_LAYOUT,
+    TILED_LAYOUT
+};
+
+const int ImageTileWidth = 8;
+
 // --------------------------------------------------------------------------
 // This class encapsulates functionality for setting pixel colours in an
 // image memory buffer, copying the buffer into an OpenGL window for display,
@@ -34,37 +52,119 @@ class ImageBuffer
     GLuint  m_textureName;
     GLuint  m_framebufferObject;
 
-    // dimensions of our image, and the pixel colour data array
+    // dimensions of our image, and the pixel colour data array, with each
+    // pixel m_pixelBytes long in m_format; a tiled image is padded out to
+    // whole tiles, m_tilesX x m_tilesY of them
     int     m_width, m_height;
-    std::vector<glm::vec3> m_imageData;
+    PixelLayout m_layout;
+    PixelFormat m_format;
+    int     m_pixelBytes;
+    int     m_tilesX, m_tilesY;
+    std::vector<unsigned char> m_imageData;
+
+    // how colours become the RGBA8 texels shown and the bytes saved
+    colorEncoding m_encoding;
+
+    // pixels copied out for OpenGL or a file, a row or rectangle at a time,
+    // and the RGB and RGBA8 bytes they are encoded into for OpenGL
+    std::vector<glm::vec3> m_uploadRows;
+    std::vector<unsigned char> m_encodedRow;
+    std::vector<unsigned char> m_uploadBytes;
 
-    // state variables to keep track of modified region
-    bool    m_modified;
-    int     m_modifiedLower, m_modifiedUpper;
+    // one bit per ImageTileWidth x ImageTileWidth tile (in either layout)
+    // that has changed since the last Render(); writers set bits with an
+    // atomic or and Render() takes whole words with an exchange, so any
+    // number of threads may write while it runs without sharing a lock
+    typedef unsigned long long DirtyWord;
+    std::unique_ptr<std::atomic<DirtyWord>[]> m_dirtyTiles;
+    int     m_dirtyWords;
+    std::vector<DirtyWord> m_takenTiles;    // Render()'s copy
 
+    void MarkDirty(int tileX, int tileY);
     void ResetModified();
 
+    // allocates the pixel colour data array and fills it with a checkerboard
+    void AllocateImage(int width, int height);
+
+    int PixelIndex(int x, int y) const
+    {
+        if (m_layout == LINEAR_LAYOUT)
+            return y * m_width + x;
+        int tile = (y / ImageTileWidth) * m_tilesX + x / ImageTileWidth;
+        return tile * ImageTileWidth * ImageTileWidth
+             + (y % ImageTileWidth) * ImageTileWidth + x % ImageTileWidth;
+    }
+
+    unsigned char *PixelData(int x, int y)
+    {
+        return &m_imageData[size_t(PixelIndex(x, y)) * m_pixelBytes];
+    }
+    const unsigned char *PixelData(int x, int y) const
+    {
+        return &m_imageData[size_t(PixelIndex(x, y)) * m_pixelBytes];
+    }
+
+    // rows [lower, upper) as floats in linear order, in m_uploadRows
+    const glm::vec3 *LinearRows(int lower, int upper);
+
+    // the w x h block with (x0, y0) at its bottom-left as RGBA8 texels, in
+    // m_uploadBytes
+    const unsigned char *EncodeTexels(int x0, int y0, int w, int h);
+
 public:
-    ImageBuffer();
+    explicit ImageBuffer(PixelLayout layout = TILED_LAYOUT,
+                         PixelFormat format = RGB32F_FORMAT);
     ~ImageBuffer();
 
     // returns the width or height of the currently allocated image
     int Width() const  { return m_width; }
     int Height() const { return m_height; }
+    PixelLayout Layout() const { return m_layout; }
+    PixelFormat Format() const { return m_format; }
+
+    // how colours are encoded for display and 8-bit files; changing it
+    // marks the whole image for upload
+    const colorEncoding &Encoding() const { return m_encoding; }
+    void SetEncoding(const colorEncoding &encoding);
 
     // call this after your OpenGL context is all set up to create an image
     // buffer that matches the size of your viewport
     bool Initialize();
 
-    // set a pixel in this image buffer to a specified colour:
+    // creates an image buffer of the given size in memory only, without
+    // touching OpenGL; use this for headless (batch) rendering, where
+    // Render() does nothing and the result is retrieved with SaveToFile()
+    bool Initialize(int width, int height);
+
+    // set a pixel in this image buffer to a specified colour, which is
+    // packed into the buffer's format (and so may lose precision):
     //  - (0,0) is the bottom-left pixel of the image
     //  - colour is RGB given as floating point numbers in the range [0,1]
+    //  - safe to call from several threads, as long as they write different
+    //    pixels and none of them calls Render() or SaveToFile() meanwhile
     void SetPixel(int x, int y, glm::vec3 colour);
 
-    // call this in your render function to copy this image onto your screen
+    // copy the w x h block of pixels with (x0, y0) at its bottom-left into
+    // or out of the image; pixels holds w colours per row, bottom row first,
+    // packed into or unpacked from the buffer's format on the way
+    //  - any number of threads may write (disjoint) blocks at once, but
+    //    all of them must have returned before Render() or SaveToFile() is
+    //    called: Render() uploads whole bands of tiles, clean ones included,
+    //    so it would read pixels a writer was still storing
+    //  - render threads should write whole tiles like this rather than
+    //    call SetPixel, which touches shared state on every pixel
+    void WriteTile(int x0, int y0, int w, int h, const glm::vec3 *pixels);
+    void ReadTile(int x0, int y0, int w, int h, glm::vec3 *pixels) const;
+
+    // call this in your render function to copy this image onto your screen;
+    // only the bands of tiles written since the last call are uploaded, and
+    // no WriteTile() may be running meanwhile
     void Render();
 
     // call this at the end of your render to save the image to file
+    //  - sees every tile whose WriteTile() returned before it was called
+    //  - .ppm, .pfm and .png files are always written natively (see
+    //    ImageWriter.h); other formats need one of the image libraries
     bool SaveToFile(const std::string &imageFileName);
 };
 
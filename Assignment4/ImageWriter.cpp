@@ -0,0 +1,260 @@
+// ==========================================================================
+// Native Image Writers
+// ==========================================================================
+
+#include "ImageWriter.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+// --------------------------------------------------------------------------
+
+namespace
+{
+    // CRC-32 as PNG chunks use it, a byte at a time from a table
+    struct crcTable
+    {
+        unsigned int entries[256];
+
+        crcTable()
+        {
+            for (unsigned int n = 0; n < 256; ++n)
+            {
+                unsigned int c = n;
+                for (int k = 0; k < 8; ++k)
+                    c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                entries[n] = c;
+            }
+        }
+    };
+    const crcTable CrcTable;
+
+    unsigned int updateCrc(unsigned int crc, const unsigned char *bytes, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+            crc = CrcTable.entries[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+        return crc;
+    }
+
+    void putBigEndian(unsigned char *bytes, unsigned int value)
+    {
+        bytes[0] = (unsigned char)(value >> 24);
+        bytes[1] = (unsigned char)(value >> 16);
+        bytes[2] = (unsigned char)(value >> 8);
+        bytes[3] = (unsigned char)value;
+    }
+
+    // ----------------------------------------------------------------------
+    // Writes a PNG whose zlib stream is made of stored deflate blocks, each
+    // in its own IDAT chunk: every inflater reads it, and writing costs no
+    // more than the two checksums.
+    class pngStream
+    {
+        ofstream &m_file;
+        vector<unsigned char> m_block;  // stored block being filled
+        unsigned int m_adlerA, m_adlerB;
+        bool m_started;
+
+        static const size_t MaxBlock = 65535;
+
+        void Chunk(const char *type, const unsigned char *prefix, size_t prefixSize,
+                   const unsigned char *data, size_t size,
+                   const unsigned char *suffix, size_t suffixSize)
+        {
+            unsigned char length[4];
+            putBigEndian(length, unsigned(prefixSize + size + suffixSize));
+            m_file.write((const char *)length, 4);
+
+            unsigned int crc = 0xffffffffu;
+            crc = updateCrc(crc, (const unsigned char *)type, 4);
+            crc = updateCrc(crc, prefix, prefixSize);
+            crc = updateCrc(crc, data, size);
+            crc = updateCrc(crc, suffix, suffixSize);
+            m_file.write(type, 4);
+            m_file.write((const char *)prefix, prefixSize);
+            m_file.write((const char *)data, size);
+            m_file.write((const char *)suffix, suffixSize);
+
+            unsigned char check[4];
+            putBigEndian(check, crc ^ 0xffffffffu);
+            m_file.write((const char *)check, 4);
+        }
+
+        void FlushBlock(bool final)
+        {
+            // zlib header (deflate, 32K window, no preset dictionary) ahead
+            // of the first block, then the stored block header
+            unsigned char prefix[7];
+            size_t prefixSize = 0;
+            if (!m_started)
+            {
+                prefix[prefixSize++] = 0x78;
+                prefix[prefixSize++] = 0x01;
+                m_started = true;
+            }
+            unsigned int size = unsigned(m_block.size());
+            prefix[prefixSize++] = final ? 1 : 0;
+            prefix[prefixSize++] = (unsigned char)size;
+            prefix[prefixSize++] = (unsigned char)(size >> 8);
+            prefix[prefixSize++] = (unsigned char)~size;
+            prefix[prefixSize++] = (unsigned char)(~size >> 8);
+
+            unsigned char adler[4];
+            putBigEndian(adler, (m_adlerB << 16) | m_adlerA);
+            Chunk("IDAT", prefix, prefixSize, m_block.empty() ? 0 : &m_block[0], size,
+                  adler, final ? 4 : 0);
+            m_block.clear();
+        }
+
+        void UpdateAdler(const unsigned char *bytes, size_t size)
+        {
+            // 5552 bytes is the most that cannot overflow before the modulo
+            while (size > 0)
+            {
+                size_t run = std::min(size, size_t(5552));
+                for (size_t i = 0; i < run; ++i)
+                {
+                    m_adlerA += bytes[i];
+                    m_adlerB += m_adlerA;
+                }
+                m_adlerA %= 65521;
+                m_adlerB %= 65521;
+                bytes += run;
+                size -= run;
+            }
+        }
+
+    public:
+        explicit pngStream(ofstream &file)
+            : m_file(file), m_adlerA(1), m_adlerB(0), m_started(false)
+        {
+            m_block.reserve(MaxBlock);
+        }
+
+        void Header(int width, int height)
+        {
+            static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+            m_file.write((const char *)signature, 8);
+
+            // 8-bit RGB, deflate, adaptive filtering (always None), no interlace
+            unsigned char header[13] = { 0 };
+            putBigEndian(header, width);
+            putBigEndian(header + 4, height);
+            header[8] = 8;
+            header[9] = 2;
+            Chunk("IHDR", header, 13, 0, 0, 0, 0);
+        }
+
+        // appends bytes to the image data, in blocks of at most MaxBlock
+        void Write(const unsigned char *bytes, size_t size)
+        {
+            UpdateAdler(bytes, size);
+            while (size > 0)
+            {
+                size_t run = std::min(size, MaxBlock - m_block.size());
+                m_block.insert(m_block.end(), bytes, bytes + run);
+                if (m_block.size() == MaxBlock)
+                    FlushBlock(false);
+                bytes += run;
+                size -= run;
+            }
+        }
+
+        void Finish()
+        {
+            FlushBlock(true);
+            Chunk("IEND", 0, 0, 0, 0, 0, 0);
+        }
+    };
+
+    // ----------------------------------------------------------------------
+
+    bool hasExtension(const string &fileName, const char *extension)
+    {
+        size_t length = strlen(extension);
+        if (fileName.size() <= length)
+            return false;
+        for (size_t i = 0; i < length; ++i)
+            if (tolower(fileName[fileName.size() - length + i]) != extension[i])
+                return false;
+        return true;
+    }
+
+    // PFM says which byte order its floats are in by the sign of the scale
+    bool littleEndian()
+    {
+        unsigned int probe = 1;
+        return *(const unsigned char *)&probe == 1;
+    }
+}
+
+// --------------------------------------------------------------------------
+
+bool imageFileFormat(const string &fileName, ImageFileFormat *format)
+{
+    if (hasExtension(fileName, ".ppm"))
+        *format = PPM_IMAGE;
+    else if (hasExtension(fileName, ".pfm"))
+        *format = PFM_IMAGE;
+    else if (hasExtension(fileName, ".png"))
+        *format = PNG_IMAGE;
+    else
+        return false;
+    return true;
+}
+
+bool writeImage(const string &fileName, ImageFileFormat format,
+                int width, int height, const ImageRows &rows,
+                const colorEncoding &encoding)
+{
+    ofstream file(fileName, ios::binary);
+    if (!file)
+    {
+        cout << "ImageWriter ERROR: Could not open " << fileName << endl;
+        return false;
+    }
+
+    if (format == PFM_IMAGE)
+    {
+        // PFM stores the bottom row first, as we do, and floats as they are
+        file << "PF\n" << width << " " << height << "\n"
+             << (littleEndian() ? "-1.0" : "1.0") << "\n";
+        for (int y = 0; y < height; ++y)
+            file.write((const char *)rows(y), width * sizeof(vec3));
+        return bool(file);
+    }
+
+    // PPM and PNG store the top row first; a row of vec3s is just
+    // 3 * width floats to the encoding kernel. PNG rows start with the
+    // filter type, which is left as 0 (None).
+    vector<unsigned char> row(1 + width * 3, 0);
+    if (format == PPM_IMAGE)
+    {
+        file << "P6\n" << width << " " << height << "\n255\n";
+        for (int y = height-1; y >= 0; --y)
+        {
+            activeKernels.encodeRow(&rows(y)->x, width, y, encoding, &row[1]);
+            file.write((const char *)&row[1], width * 3);
+        }
+    }
+    else
+    {
+        pngStream png(file);
+        png.Header(width, height);
+        for (int y = height-1; y >= 0; --y)
+        {
+            activeKernels.encodeRow(&rows(y)->x, width, y, encoding, &row[1]);
+            png.Write(&row[0], row.size());
+        }
+        png.Finish();
+    }
+    return bool(file);
+}
+
+// --------------------------------------------------------------------------
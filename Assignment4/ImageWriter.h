@@ -0,0 +1,40 @@
+// ==========================================================================
+// Native Image Writers
+//  - binary PPM, PFM (32-bit float) and PNG, written without any image
+//    library so that headless hosts can save what they render
+//  - images are streamed out a row at a time: nothing the size of the
+//    whole image is allocated, however large it is
+// ==========================================================================
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#include <functional>
+#include <string>
+#include <glm/vec3.hpp>
+#include "KernelDispatch.h"
+
+enum ImageFileFormat
+{
+    PPM_IMAGE,          // 8 bits per channel
+    PFM_IMAGE,          // 32-bit float per channel, unclamped
+    PNG_IMAGE           // 8 bits per channel, deflate stored (uncompressed)
+};
+
+// the format the extension of fileName asks for; false if it is not one
+// that is written natively
+bool imageFileFormat(const std::string &fileName, ImageFileFormat *format);
+
+// returns row y of the image (0 at the bottom) as width colours; the
+// pointer only has to stay valid until the next call
+typedef std::function<const glm::vec3 *(int y)> ImageRows;
+
+// writes a width x height image to fileName, asking rows for each row in
+// whatever order the format stores them; 8-bit formats are encoded as
+// encoding says, while PFM keeps the colours as they are. False, with a
+// message, if the file could not be written.
+bool writeImage(const std::string &fileName, ImageFileFormat format,
+                int width, int height, const ImageRows &rows,
+                const colorEncoding &encoding);
+
+// --------------------------------------------------------------------------
+#endif // IMAGEWRITER_H
@@ -0,0 +1,173 @@
+// ==========================================================================
+// Kernel Dispatch
+// ==========================================================================
+
+#include <cctype>
+#include "KernelDispatch.h"
+#include "KernelTemplates.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <cpuid.h>
+#endif
+
+using namespace std;
+
+// each in its own translation unit, compiled for its instruction set; they
+// return false if the compiler could not build them
+bool sse42Kernels(kernelTable *table);
+bool avx2Kernels(kernelTable *table);
+bool avx512Kernels(kernelTable *table);
+
+// --------------------------------------------------------------------------
+
+namespace
+{
+    const char *const IsaNames[ISA_COUNT] = { "baseline", "sse4.2", "avx2", "avx512" };
+
+    // what both the CPU and the operating system support
+    struct cpuFeatures
+    {
+        bool sse42, avx2, avx512;
+    };
+
+    // registers eax, ebx, ecx and edx after cpuid; zeros off x86
+    void cpuid(unsigned leaf, unsigned subleaf, unsigned registers[4])
+    {
+        registers[0] = registers[1] = registers[2] = registers[3] = 0;
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+        int values[4];
+        __cpuidex(values, int(leaf), int(subleaf));
+        for (int i = 0; i < 4; ++i)
+            registers[i] = unsigned(values[i]);
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+        if (leaf <= __get_cpuid_max(0, 0))
+            __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+    }
+
+    // the register states the operating system saves on a context switch;
+    // only to be read once cpuid reports OSXSAVE
+    unsigned long long xcr0()
+    {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+        return _xgetbv(0);
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+        unsigned low, high;
+        __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+        return (unsigned long long)(high) << 32 | low;
+#else
+        return 0;
+#endif
+    }
+
+    cpuFeatures detectFeatures()
+    {
+        unsigned basic[4], leaf1[4], leaf7[4];
+        cpuid(0, 0, basic);
+        cpuid(1, 0, leaf1);
+        if (basic[0] >= 7)
+            cpuid(7, 0, leaf7);
+        else
+            leaf7[0] = leaf7[1] = leaf7[2] = leaf7[3] = 0;
+
+        // AVX registers are only usable if the OS saves the SSE and AVX
+        // state (XCR0 bits 1 and 2), and AVX-512 ones the opmask and upper
+        // ZMM state too (bits 5 to 7)
+        bool osxsave = (leaf1[2] >> 27 & 1) != 0;
+        unsigned long long xcr = osxsave ? xcr0() : 0;
+        bool avxState = (xcr & 0x6) == 0x6;
+        bool avx512State = (xcr & 0xe6) == 0xe6;
+
+        cpuFeatures features;
+        features.sse42 = (leaf1[2] >> 19 & 1) && (leaf1[2] >> 20 & 1);
+        features.avx2 = features.sse42 && avxState && (leaf1[2] >> 28 & 1) &&
+                        (leaf1[2] >> 12 & 1) && (leaf7[1] >> 5 & 1);
+        features.avx512 = features.avx2 && avx512State && (leaf7[1] >> 16 & 1);
+        return features;
+    }
+
+    const cpuFeatures cpu = detectFeatures();
+
+    // fills in table, if the CPU can run isa's kernels and they were built
+    bool loadKernels(KernelIsa isa, kernelTable *table)
+    {
+        switch (isa)
+        {
+        case ISA_BASELINE:
+#if defined(SIMD_LANES_SSE2)
+            fillKernels<sse2Lanes>(table, "SSE2");
+#else
+            fillKernels<scalarLanes>(table, "scalar");
+#endif
+            return true;
+        case ISA_SSE42:
+            return cpu.sse42 && sse42Kernels(table);
+        case ISA_AVX2:
+            return cpu.avx2 && avx2Kernels(table);
+        case ISA_AVX512:
+            return cpu.avx512 && avx512Kernels(table);
+        default:
+            return false;
+        }
+    }
+
+    kernelTable bestKernels()
+    {
+        kernelTable table;
+        loadKernels(bestIsa(), &table);
+        return table;
+    }
+}
+
+kernelTable activeKernels = bestKernels();
+
+// --------------------------------------------------------------------------
+
+bool isaAvailable(KernelIsa isa)
+{
+    kernelTable table;
+    return loadKernels(isa, &table);
+}
+
+KernelIsa bestIsa()
+{
+    for (int isa = ISA_COUNT - 1; isa > ISA_BASELINE; --isa)
+        if (isaAvailable(KernelIsa(isa)))
+            return KernelIsa(isa);
+    return ISA_BASELINE;
+}
+
+bool selectKernels(KernelIsa isa)
+{
+    return loadKernels(isa, &activeKernels);
+}
+
+const char *isaName(KernelIsa isa)
+{
+    return isa >= 0 && isa < ISA_COUNT ? IsaNames[isa] : "unknown";
+}
+
+bool parseIsa(const string &name, KernelIsa *isa)
+{
+    string lower;
+    for (size_t i = 0; i < name.size(); ++i)
+        lower += char(tolower((unsigned char)(name[i])));
+
+    if (lower == "best")
+    {
+        *isa = bestIsa();
+        return true;
+    }
+    for (int i = 0; i < ISA_COUNT; ++i)
+    {
+        if (lower == IsaNames[i])
+        {
+            *isa = KernelIsa(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// --------------------------------------------------------------------------
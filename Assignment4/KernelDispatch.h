@@ -0,0 +1,87 @@
+// ==========================================================================
+// Kernel Dispatch
+//  - the inner loops of the tracer (block and packet intersection, Phong
+//    shading and colour encoding for display and image files) are built once for each
+//    instruction set in their own translation unit, KernelsSSE42.cpp,
+//    KernelsAVX2.cpp and KernelsAVX512.cpp, plus a baseline that any CPU
+//    the build targets can run
+//  - at startup the CPU is asked what it supports and activeKernels is
+//    bound to the best of them; selectKernels() picks another, which is how
+//    --isa compares them
+// ==========================================================================
+#ifndef KERNELDISPATCH_H
+#define KERNELDISPATCH_H
+
+#include <string>
+#include "PrimitiveBlocks.h"
+#include "RayPacket.h"
+
+enum KernelIsa
+{
+    ISA_BASELINE,       // SSE2 on x86, plain loops elsewhere
+    ISA_SSE42,
+    ISA_AVX2,
+    ISA_AVX512,
+    ISA_COUNT
+};
+
+// how colours are turned into bytes on their way to the screen or a file;
+// all off stores the colours as they are, clamped and rounded
+struct colorEncoding
+{
+    bool toneMap;       // Reinhard x / (1 + x), instead of clipping above 1
+    bool srgb;          // the sRGB transfer curve, for linear colours
+    bool dither;        // 4x4 ordered dither instead of rounding
+};
+
+// one implementation of every kernel; see PrimitiveBlocks.h, RayPacket.h
+// and the functions that call through it for what each one does
+struct kernelTable
+{
+    const char *name;
+
+    bool (*closestHitTriangles)(const triangleBlock *blocks, int count, const ray &r,
+                                float tMin, float *tMax, primitiveRef *hit);
+    bool (*closestHitSpheres)(const sphereBlock *blocks, int count, const ray &r,
+                              float tMin, float *tMax, primitiveRef *hit);
+    bool (*anyHitTriangles)(const triangleBlock *blocks, int count, const ray &r,
+                            float tMin, float tMax);
+    bool (*anyHitSpheres)(const sphereBlock *blocks, int count, const ray &r,
+                          float tMin, float tMax);
+
+    // packetBoxHits(), with *nearest only ever lowered
+    packetMask (*boxHits)(const rayPacket &packet, packetMask active, const float *tMax,
+                          const glm::vec3 &lower, const glm::vec3 &upper, float *nearest);
+
+    // adds the diffuse and specular light from l to the first count lanes
+    // of packet that are set in lit
+    void (*phong)(shadingPacket *packet, int count, const light &l, packetMask lit);
+
+    // encodes pixels RGB colours from row y of an image into 3 * pixels
+    // bytes: each value is clamped (or tone mapped) to [0, 1], encoded and
+    // scaled to [0, 255]; the dither pattern assumes the first pixel is in
+    // a column that is a multiple of 4
+    void (*encodeRow)(const float *rgb, int pixels, int y, const colorEncoding &encoding,
+                      unsigned char *bytes);
+};
+
+// the kernels in use; bound before main() runs, so never null
+extern kernelTable activeKernels;
+
+// true if the CPU can run isa and this build has kernels for it
+bool isaAvailable(KernelIsa isa);
+
+// the best instruction set isaAvailable() allows
+KernelIsa bestIsa();
+
+// binds activeKernels to isa; false, leaving them alone, if it is not
+// available. Not safe while anything is rendering.
+bool selectKernels(KernelIsa isa);
+
+const char *isaName(KernelIsa isa);
+
+// accepts the names isaName() returns, in any case, and "best"
+bool parseIsa(const std::string &name, KernelIsa *isa);
+
+// --------------------------------------------------------------------------
+#endif // KERNELDISPATCH_H
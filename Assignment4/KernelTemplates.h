@@ -0,0 +1,400 @@
+// ==========================================================================
+// Kernel Templates
+//  - the kernels of KernelDispatch.h, written once against the lane types
+//    of SimdLanes.h; each kernel translation unit includes this once it has
+//    chosen its instruction set, and fills a table with fillKernels()
+//  - nothing here may call an inline function from another header (glm's
+//    included), for the reason given in SimdLanes.h, so vectors are read a
+//    component at a time
+// ==========================================================================
+#ifndef KERNELTEMPLATES_H
+#define KERNELTEMPLATES_H
+
+#include "KernelDispatch.h"
+#include "SimdLanes.h"
+
+namespace
+{
+
+inline float axisOf(const glm::vec3 &v, int axis)
+{
+    return (&v.x)[axis];
+}
+
+// L::Width consecutive floats from p
+template<class L>
+typename L::Float loadLanes(const float *p)
+{
+    return L::Load(p, p + (L::Width > 8 ? 8 : 0));
+}
+
+// declared first thing in each kernel, so L::Leave() runs on every way out
+template<class L>
+struct kernelExit
+{
+    ~kernelExit() { L::Leave(); }
+};
+
+// --------------------------------------------------------------------------
+// Primitive blocks
+
+// one ray broadcast to every lane
+template<class L>
+struct rayLanes
+{
+    typename L::Float origin[3], direction[3];
+    typename L::Float twoA, fourA;      // for the sphere quadratic
+
+    explicit rayLanes(const ray &r)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            origin[axis] = L::Set(axisOf(r.origin, axis));
+            direction[axis] = L::Set(axisOf(r.direction, axis));
+        }
+        float a = r.direction.x * r.direction.x + r.direction.y * r.direction.y +
+                  r.direction.z * r.direction.z;
+        twoA = L::Set(2 * a);
+        fourA = L::Set(4 * a);
+    }
+};
+
+// Moller-Trumbore on the lanes starting at lane of lo (running on into
+// hi for 16 lanes); sets *t and returns which lanes hit in (tMin, tMax)
+template<class L>
+typename L::Mask hitLanes(const triangleBlock &lo, const triangleBlock &hi, int lane,
+                          const rayLanes<L> &r, typename L::Float tMin,
+                          typename L::Float tMax, typename L::Float *t)
+{
+    typedef typename L::Float F;
+    F P0x = L::Load(lo.P0[0] + lane, hi.P0[0]);
+    F P0y = L::Load(lo.P0[1] + lane, hi.P0[1]);
+    F P0z = L::Load(lo.P0[2] + lane, hi.P0[2]);
+    F e1x = L::Load(lo.e1[0] + lane, hi.e1[0]);
+    F e1y = L::Load(lo.e1[1] + lane, hi.e1[1]);
+    F e1z = L::Load(lo.e1[2] + lane, hi.e1[2]);
+    F e2x = L::Load(lo.e2[0] + lane, hi.e2[0]);
+    F e2y = L::Load(lo.e2[1] + lane, hi.e2[1]);
+    F e2z = L::Load(lo.e2[2] + lane, hi.e2[2]);
+    const F &dx = r.direction[0], &dy = r.direction[1], &dz = r.direction[2];
+
+    // p = d x e2, and unused lanes get det == 0, so NaNs that fail
+    // every comparison below
+    F px = dy * e2z - e2y * dz;
+    F py = dz * e2x - e2z * dx;
+    F pz = dx * e2y - e2x * dy;
+    F invDet = L::Set(1.f) / (e1x * px + e1y * py + e1z * pz);
+
+    F sx = r.origin[0] - P0x, sy = r.origin[1] - P0y, sz = r.origin[2] - P0z;
+    F u = (sx * px + sy * py + sz * pz) * invDet;
+    F qx = sy * e1z - e1y * sz;
+    F qy = sz * e1x - e1z * sx;
+    F qz = sx * e1y - e1x * sy;
+    F v = (dx * qx + dy * qy + dz * qz) * invDet;
+    *t = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+
+    // the same barycentric slack as intersectMeshTriangle()
+    F low = L::Set(-1e-5f), high = L::Set(1 + 1e-5f);
+    return (u >= low) & (u <= high) & (v >= low) & (u + v <= high) &
+           (*t > tMin) & (*t < tMax);
+}
+
+// the sphere quadratic as intersectSphere() solves it, nearer root first
+template<class L>
+typename L::Mask hitLanes(const sphereBlock &lo, const sphereBlock &hi, int lane,
+                          const rayLanes<L> &r, typename L::Float tMin,
+                          typename L::Float tMax, typename L::Float *t)
+{
+    typedef typename L::Float F;
+    F ocx = r.origin[0] - L::Load(lo.center[0] + lane, hi.center[0]);
+    F ocy = r.origin[1] - L::Load(lo.center[1] + lane, hi.center[1]);
+    F ocz = r.origin[2] - L::Load(lo.center[2] + lane, hi.center[2]);
+    F radiusSquared = L::Load(lo.radiusSquared + lane, hi.radiusSquared);
+
+    F b = L::Set(2.f) * (r.direction[0] * ocx + r.direction[1] * ocy + r.direction[2] * ocz);
+    F c = (ocx * ocx + ocy * ocy + ocz * ocz) - radiusSquared;
+    F determ = b * b - r.fourA * c;
+
+    // clamped so missing lanes never take the slow path of a NaN root
+    F root = L::Sqrt(L::Max(determ, L::Set(0.f)));
+    F t1 = (L::Set(0.f) - b - root) / r.twoA;
+    F t2 = (L::Set(0.f) - b + root) / r.twoA;
+    *t = L::Select(t1 > tMin, t1, t2);
+    return (determ >= L::Set(0.f)) & (*t > tMin) & (*t < tMax);
+}
+
+// groups of L::Width lanes per block, and blocks per group
+template<class L>
+struct blockGroups
+{
+    enum
+    {
+        PerBlock = L::Width < BlockWidth ? BlockWidth / L::Width : 1,
+        Span = L::Width > BlockWidth ? L::Width / BlockWidth : 1
+    };
+};
+
+template<class L, class Block>
+bool closestHitLanes(const Block *blocks, int count, const ray &r, float tMin,
+                     float *tMax, primitiveRef *hit)
+{
+    typedef blockGroups<L> G;
+    kernelExit<L> exit;
+    if (count == 0) return false;
+    rayLanes<L> lanes(r);
+    typename L::Float tMinLanes = L::Set(tMin);
+    bool found = false;
+
+    for (int b = 0; b < count; b += G::Span)
+    {
+        // an odd block out repeats itself in the high half
+        const Block &lo = blocks[b];
+        const Block &hi = blocks[b + G::Span - 1 < count ? b + G::Span - 1 : b];
+        for (int g = 0; g < G::PerBlock; ++g)
+        {
+            typename L::Float t;
+            unsigned bits = L::Bits(hitLanes<L>(lo, hi, g * L::Width, lanes,
+                                                tMinLanes, L::Set(*tMax), &t));
+            if (bits == 0) continue;
+
+            float tLane[L::Width];
+            L::Store(tLane, t);
+            for (int i = 0; i < L::Width; ++i)
+            {
+                if ((bits >> i & 1) && tLane[i] < *tMax)
+                {
+                    *tMax = tLane[i];
+                    *hit = (i < BlockWidth ? lo : hi).primitive[(g * L::Width + i) % BlockWidth];
+                    found = true;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+template<class L, class Block>
+bool anyHitLanes(const Block *blocks, int count, const ray &r, float tMin, float tMax)
+{
+    typedef blockGroups<L> G;
+    kernelExit<L> exit;
+    if (count == 0) return false;
+    rayLanes<L> lanes(r);
+    typename L::Float tMinLanes = L::Set(tMin), tMaxLanes = L::Set(tMax);
+
+    for (int b = 0; b < count; b += G::Span)
+    {
+        const Block &lo = blocks[b];
+        const Block &hi = blocks[b + G::Span - 1 < count ? b + G::Span - 1 : b];
+        for (int g = 0; g < G::PerBlock; ++g)
+        {
+            typename L::Float t;
+            if (L::Bits(hitLanes<L>(lo, hi, g * L::Width, lanes, tMinLanes, tMaxLanes, &t)))
+                return true;
+        }
+    }
+    return false;
+}
+
+// --------------------------------------------------------------------------
+// Ray packets
+
+template<class L>
+packetMask boxHitLanes(const rayPacket &packet, packetMask active, const float *tMax,
+                       const glm::vec3 &lower, const glm::vec3 &upper, float *nearest)
+{
+    typedef typename L::Float F;
+    kernelExit<L> exit;
+    const unsigned groupMask = (1u << L::Width) - 1;
+
+    packetMask hits = 0;
+    for (int first = 0; first < PacketSize; first += L::Width)
+    {
+        unsigned group = unsigned(active >> first) & groupMask;
+        if (group == 0) continue;
+
+        // the slab test of BVH::IntersectBox, a lane per ray; a NaN
+        // from a ray lying in a slab plane leaves tNear and tFar alone
+        F tNear = L::Set(0.f);
+        F tFar = loadLanes<L>(tMax + first);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            F origin = loadLanes<L>(packet.origin[axis] + first);
+            F inverse = loadLanes<L>(packet.invDirection[axis] + first);
+            F t0 = (L::Set(axisOf(lower, axis)) - origin) * inverse;
+            F t1 = (L::Set(axisOf(upper, axis)) - origin) * inverse;
+            tNear = L::Max(L::Min(t0, t1), tNear);
+            tFar = L::Min(L::Max(t0, t1), tFar);
+        }
+
+        unsigned bits = L::Bits(tNear <= tFar) & group;
+        if (bits == 0) continue;
+        hits |= packetMask(bits) << first;
+
+        float entry[L::Width];
+        L::Store(entry, tNear);
+        for (int i = 0; i < L::Width; ++i)
+            if ((bits >> i & 1) && entry[i] < *nearest)
+                *nearest = entry[i];
+    }
+    return hits;
+}
+
+// --------------------------------------------------------------------------
+// Shading
+
+template<class L>
+void normalizeLanes(typename L::Float v[3])
+{
+    typename L::Float scale = L::Set(1.f) / L::Sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    for (int axis = 0; axis < 3; ++axis)
+        v[axis] = v[axis] * scale;
+}
+
+template<class L>
+typename L::Float dotLanes(const typename L::Float a[3], const typename L::Float b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// The Phong model for the L::Width lanes from first that are set in lit:
+// n.l of diffuse, and where specular is set a highlight of (n.h)^16 with
+// ks = 0.7, h being halfway between the directions to the light and the
+// eye. The ambient term is left to the caller.
+template<class L>
+void phongGroup(shadingPacket *packet, int first, const light &l, unsigned lit)
+{
+    typedef typename L::Float F;
+    F n[3], toLight[3], toEye[3], half[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        F point = loadLanes<L>(packet->point[axis] + first);
+        n[axis] = loadLanes<L>(packet->normal[axis] + first);
+        toLight[axis] = L::Set(axisOf(l.position, axis)) - point;
+        toEye[axis] = loadLanes<L>(packet->eye[axis] + first) - point;
+    }
+    normalizeLanes<L>(n);
+    normalizeLanes<L>(toLight);
+    normalizeLanes<L>(toEye);
+    for (int axis = 0; axis < 3; ++axis)
+        half[axis] = toEye[axis] + toLight[axis];
+    normalizeLanes<L>(half);
+
+    F intensity = L::Set(l.intensity);
+    F diffuse = intensity * L::Max(dotLanes<L>(n, toLight), L::Set(0.f));
+    F power = L::Max(dotLanes<L>(n, half), L::Set(0.f));
+    power = power * power;
+    power = power * power;
+    power = power * power;
+    power = power * power;
+    F highlight = L::Set(0.7f) * intensity * power * loadLanes<L>(packet->specular + first);
+
+    typename L::Mask mask = L::FromBits(lit);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        F color = loadLanes<L>(packet->color[axis] + first);
+        F base = loadLanes<L>(packet->base[axis] + first);
+        L::Store(packet->color[axis] + first,
+                 L::Select(mask, color + (base * diffuse + highlight), color));
+    }
+}
+
+// whole groups of lanes, then the rest one at a time, so no lane past
+// count is ever read
+template<class L>
+void phongLanes(shadingPacket *packet, int count, const light &l, packetMask lit)
+{
+    kernelExit<L> exit;
+    const unsigned groupMask = (1u << L::Width) - 1;
+    int first = 0;
+    for (; first + L::Width <= count; first += L::Width)
+    {
+        unsigned group = unsigned(lit >> first) & groupMask;
+        if (group != 0)
+            phongGroup<L>(packet, first, l, group);
+    }
+    for (; first < count; ++first)
+        if (lit >> first & 1)
+            phongGroup<scalarLanes>(packet, first, l, 1);
+}
+
+// --------------------------------------------------------------------------
+// Colour conversion
+
+// thresholds for ordered dithering, for every float of a row of RGB pixels:
+// the 4x4 Bayer matrix repeats every 12 floats across a row, and 16 more
+// let a group of lanes load from any offset into it
+struct ditherTable
+{
+    float rows[4][12 + 16];
+
+    ditherTable()
+    {
+        static const int bayer[4][4] = { { 0, 8, 2, 10 }, { 12, 4, 14, 6 },
+                                         { 3, 11, 1, 9 }, { 15, 7, 13, 5 } };
+        for (int y = 0; y < 4; ++y)
+            for (int i = 0; i < 12 + 16; ++i)
+                rows[y][i] = (bayer[y][i / 3 % 4] + 0.5f) / 16.f;
+    }
+};
+const ditherTable DitherTable;
+
+// the sRGB curve for x in [0, 1]; the power 1 / 2.4 is fitted with square
+// roots, to within a quarter of a level at 8 bits
+template<class L>
+typename L::Float srgbLanes(typename L::Float x)
+{
+    typename L::Float s1 = L::Sqrt(x), s2 = L::Sqrt(s1), s3 = L::Sqrt(s2);
+    typename L::Float curve = L::Set(0.662002687f) * s1 + L::Set(0.684122060f) * s2
+                            - L::Set(0.323583601f) * s3 - L::Set(0.0225411470f) * x;
+    return L::Select(x <= L::Set(0.0031308f), x * L::Set(12.92f), curve);
+}
+
+template<class L>
+void encodeGroup(const float *values, const float *thresholds,
+                 const colorEncoding &encoding, unsigned char *bytes)
+{
+    typename L::Float x = L::Max(loadLanes<L>(values), L::Set(0.f));
+    if (encoding.toneMap)
+        x = x / (L::Set(1.f) + x);
+    x = L::Min(x, L::Set(1.f));
+    if (encoding.srgb)
+        x = srgbLanes<L>(x);
+
+    // truncating x * 255 + threshold rounds for 0.5, and dithers otherwise
+    typename L::Float threshold = encoding.dither ? loadLanes<L>(thresholds) : L::Set(0.5f);
+    L::StoreBytes(bytes, x * L::Set(255.f) + threshold);
+}
+
+template<class L>
+void encodeRowLanes(const float *rgb, int pixels, int y, const colorEncoding &encoding,
+                    unsigned char *bytes)
+{
+    kernelExit<L> exit;
+    const float *thresholds = DitherTable.rows[y & 3];
+    int count = pixels * 3, i = 0, offset = 0;
+    for (; i + L::Width <= count; i += L::Width, offset = (offset + L::Width) % 12)
+        encodeGroup<L>(rgb + i, thresholds + offset, encoding, bytes + i);
+    for (; i < count; ++i, offset = (offset + 1) % 12)
+        encodeGroup<scalarLanes>(rgb + i, thresholds + offset, encoding, bytes + i);
+}
+
+// --------------------------------------------------------------------------
+
+template<class L>
+void fillKernels(kernelTable *table, const char *name)
+{
+    table->name = name;
+    table->closestHitTriangles = closestHitLanes<L, triangleBlock>;
+    table->closestHitSpheres = closestHitLanes<L, sphereBlock>;
+    table->anyHitTriangles = anyHitLanes<L, triangleBlock>;
+    table->anyHitSpheres = anyHitLanes<L, sphereBlock>;
+    table->boxHits = boxHitLanes<L>;
+    table->phong = phongLanes<L>;
+    table->encodeRow = encodeRowLanes<L>;
+}
+
+}
+
+// --------------------------------------------------------------------------
+#endif // KERNELTEMPLATES_H
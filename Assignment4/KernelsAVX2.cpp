@@ -0,0 +1,29 @@
+// ==========================================================================
+// AVX2 Kernels
+//  - the kernels of KernelTemplates.h with eight lanes; KernelDispatch.cpp
+//    only calls in here on a CPU that has AVX2 and FMA
+// ==========================================================================
+
+#include "KernelDispatch.h"
+
+// everything from here on may use AVX2; Visual C++ gets /arch:AVX2 for this
+// file instead
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC target("avx2,fma")
+#define SIMD_LANES_AVX2
+#endif
+#include "KernelTemplates.h"
+
+// --------------------------------------------------------------------------
+
+bool avx2Kernels(kernelTable *table)
+{
+#if defined(SIMD_LANES_AVX2)
+    fillKernels<avx2Lanes>(table, "AVX2");
+    return true;
+#else
+    return false;
+#endif
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,30 @@
+// ==========================================================================
+// AVX-512 Kernels
+//  - the kernels of KernelTemplates.h with sixteen lanes; KernelDispatch.cpp
+//    only calls in here on a CPU that has AVX-512
+// ==========================================================================
+
+#include "KernelDispatch.h"
+
+// everything from here on may use AVX-512; Visual C++ gets /arch:AVX512 for
+// this file, which compilers before 2017 ignore, so they leave it out
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC target("avx512f,avx2,fma")
+#define SIMD_LANES_AVX512
+#define SIMD_LANES_AVX2
+#endif
+#include "KernelTemplates.h"
+
+// --------------------------------------------------------------------------
+
+bool avx512Kernels(kernelTable *table)
+{
+#if defined(SIMD_LANES_AVX512)
+    fillKernels<avx512Lanes>(table, "AVX-512");
+    return true;
+#else
+    return false;
+#endif
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,29 @@
+// ==========================================================================
+// SSE4.2 Kernels
+//  - the kernels of KernelTemplates.h with four lanes and the SSE4.1
+//    blend; KernelDispatch.cpp only calls in here on a CPU that has SSE4.2
+// ==========================================================================
+
+#include "KernelDispatch.h"
+
+// everything from here on may use SSE4.2; Visual C++ needs no flag for it
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC target("sse4.2")
+#define SIMD_LANES_SSE4
+#define SIMD_LANES_SSE2
+#endif
+#include "KernelTemplates.h"
+
+// --------------------------------------------------------------------------
+
+bool sse42Kernels(kernelTable *table)
+{
+#if defined(SIMD_LANES_SSE4)
+    fillKernels<sse4Lanes>(table, "SSE4.2");
+    return true;
+#else
+    return false;
+#endif
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,125 @@
+// ==========================================================================
+// Memory-Mapped File
+// ==========================================================================
+
+#include <fstream>
+#include <iterator>
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// --------------------------------------------------------------------------
+
+MappedFile::MappedFile()
+    : m_data(0), m_size(0), m_mapping(0), m_descriptor(-1)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+// --------------------------------------------------------------------------
+
+bool MappedFile::Open(const string &filename)
+{
+    Close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0 &&
+        size.QuadPart <= LONGLONG(size_t(-1)))
+    {
+        HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+        if (mapping)
+        {
+            void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            // the view keeps the mapping alive on its own
+            CloseHandle(mapping);
+            if (view)
+            {
+                m_mapping = view;
+                m_data = static_cast<const char *>(view);
+                m_size = size_t(size.QuadPart);
+            }
+        }
+    }
+    CloseHandle(file);
+#else
+    int descriptor = open(filename.c_str(), O_RDONLY);
+    if (descriptor < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(descriptor, &info) == 0 && info.st_size > 0)
+    {
+        void *view = mmap(0, size_t(info.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (view != MAP_FAILED)
+        {
+            // the file is read front to back exactly once
+            madvise(view, size_t(info.st_size), MADV_SEQUENTIAL);
+            m_mapping = view;
+            m_descriptor = descriptor;
+            m_data = static_cast<const char *>(view);
+            m_size = size_t(info.st_size);
+        }
+    }
+    if (!m_mapping)
+        close(descriptor);
+#endif
+
+    if (m_mapping)
+        return true;
+
+    // empty files, and files too large for the address space of 32-bit
+    // builds, cannot be mapped; read them instead
+    ifstream input(filename.c_str(), ios::binary);
+    if (!input)
+        return false;
+    m_copy.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    m_data = m_copy.empty() ? 0 : &m_copy[0];
+    m_size = m_copy.size();
+    return true;
+}
+
+void MappedFile::Close()
+{
+    Unmap();
+    m_copy.clear();
+    m_data = 0;
+    m_size = 0;
+}
+
+void MappedFile::Unmap()
+{
+    if (!m_mapping)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_mapping);
+#else
+    munmap(m_mapping, m_size);
+    close(m_descriptor);
+    m_descriptor = -1;
+#endif
+    m_mapping = 0;
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,53 @@
+// ==========================================================================
+// Memory-Mapped File
+//  - maps a whole file read-only into the address space, so it can be
+//    parsed or used in place without copying it through stream buffers
+//  - falls back to reading the file into memory where mapping fails
+// ==========================================================================
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------------------------
+// This class owns one read-only view of a file for as long as it lives.
+
+class MappedFile
+{
+    const char *m_data;
+    size_t m_size;
+
+    // platform mapping handles; unused when the file was read instead
+    void *m_mapping;
+    int m_descriptor;
+
+    // holds the contents when the file could not be mapped
+    std::vector<char> m_copy;
+
+    void Unmap();
+
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // maps the named file, replacing any file mapped before; returns false
+    // if it cannot be opened
+    bool Open(const std::string &filename);
+    void Close();
+
+    // the file contents, valid until Close() or destruction; Data() may be
+    // null for an empty file
+    const char *Data() const    { return m_data; }
+    size_t Size() const         { return m_size; }
+
+    // true if Data() points into a mapping rather than a heap copy
+    bool IsMapped() const       { return m_mapping != 0; }
+};
+
+// --------------------------------------------------------------------------
+#endif // MAPPEDFILE_H
@@ -0,0 +1,465 @@
+// ==========================================================================
+// Mesh Import
+// ==========================================================================
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include "MeshImport.h"
+#include "MappedFile.h"
+#include "SceneParser.h"
+
+using namespace std;
+using namespace glm;
+
+// --------------------------------------------------------------------------
+
+namespace
+{
+    inline bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+    }
+
+    // finds the next word of a line, where lineEnd is the end of the line;
+    // returns false once the line runs out
+    bool nextWord(const char *&p, const char *lineEnd, const char **word, const char **wordEnd)
+    {
+        while (p < lineEnd && isSpace(*p))
+            ++p;
+        if (p == lineEnd)
+            return false;
+        *word = p;
+        while (p < lineEnd && !isSpace(*p))
+            ++p;
+        *wordEnd = p;
+        return true;
+    }
+
+    // parses all of [first, last) as a decimal integer with optional sign
+    bool parseInteger(const char *first, const char *last, long long *value)
+    {
+        bool negative = first < last && *first == '-';
+        if (first < last && (*first == '-' || *first == '+'))
+            ++first;
+        if (first == last || last - first > 18)
+            return false;
+
+        long long result = 0;
+        for (; first < last; ++first)
+        {
+            if (*first < '0' || *first > '9')
+                return false;
+            result = result * 10 + (*first - '0');
+        }
+        *value = negative ? -result : result;
+        return true;
+    }
+
+    // adds polygon, given as indices into the scene's vertex array, as a fan
+    // of triangles around its first vertex
+    void addPolygon(const vector<unsigned int> &polygon, sceneData *scene)
+    {
+        for (size_t k = 2; k < polygon.size(); ++k)
+        {
+            scene->meshIndices.push_back(polygon[0]);
+            scene->meshIndices.push_back(polygon[k - 1]);
+            scene->meshIndices.push_back(polygon[k]);
+        }
+    }
+
+    bool importError(const string &name, size_t line, const char *message)
+    {
+        cout << "ERROR: " << name << ":" << line << ": " << message << endl;
+        return false;
+    }
+
+    // ----------------------------------------------------------------------
+    // Wavefront OBJ: only "v" positions and "f" faces are read, everything
+    // else (normals, texture coordinates, groups, materials) is skipped
+
+    bool importObj(const char *data, size_t size, const string &name,
+                   sceneData *scene, meshImportStats *stats)
+    {
+        vector<vec3> &vertices = scene->meshVertices;
+        size_t firstVertex = vertices.size();
+        vector<unsigned int> polygon;
+        const char *p = data;
+        const char *end = data + size;
+        size_t line = 0;
+
+        while (p < end)
+        {
+            ++line;
+            const char *lineEnd = static_cast<const char *>(memchr(p, '\n', end - p));
+            if (!lineEnd)
+                lineEnd = end;
+            const char *q = p;
+            p = lineEnd < end ? lineEnd + 1 : end;
+
+            const char *comment = static_cast<const char *>(memchr(q, '#', lineEnd - q));
+            if (comment)
+                lineEnd = comment;
+
+            const char *word, *wordEnd;
+            if (!nextWord(q, lineEnd, &word, &wordEnd) || wordEnd - word != 1)
+                continue;
+
+            if (*word == 'v')
+            {
+                float xyz[3];
+                for (int k = 0; k < 3; ++k)
+                {
+                    if (!nextWord(q, lineEnd, &word, &wordEnd) || !parseFloat(word, wordEnd, &xyz[k]))
+                        return importError(name, line, "expected three vertex coordinates");
+                }
+                vertices.push_back(vec3(xyz[0], xyz[1], xyz[2]));
+            }
+            else if (*word == 'f')
+            {
+                polygon.clear();
+                while (nextWord(q, lineEnd, &word, &wordEnd))
+                {
+                    // "v", "v/vt", "v//vn" or "v/vt/vn"; only v is used
+                    const char *slash = static_cast<const char *>(memchr(word, '/', wordEnd - word));
+                    long long index;
+                    if (!parseInteger(word, slash ? slash : wordEnd, &index) || index == 0)
+                        return importError(name, line, "expected a vertex index");
+
+                    // indices count from 1, or back from the latest vertex if negative
+                    long long count = (long long)(vertices.size() - firstVertex);
+                    index = index < 0 ? count + index : index - 1;
+                    if (index < 0 || index >= count)
+                        return importError(name, line, "vertex index out of range");
+                    polygon.push_back((unsigned int)(firstVertex + index));
+                }
+
+                if (polygon.size() >= 3)
+                {
+                    addPolygon(polygon, scene);
+                    ++stats->faces;
+                }
+            }
+        }
+
+        stats->vertices = vertices.size() - firstVertex;
+        return true;
+    }
+
+    // ----------------------------------------------------------------------
+    // Stanford PLY: the "vertex" element's x, y and z, and the
+    // "vertex_indices" list of the "face" element; other elements and
+    // properties are read past
+
+    enum PlyType
+    {
+        PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16,
+        PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64
+    };
+
+    bool plyTypeFromName(const string &typeName, PlyType *type)
+    {
+        static const char *names[][2] = {
+            { "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" }, { "ushort", "uint16" },
+            { "int", "int32" }, { "uint", "uint32" }, { "float", "float32" }, { "double", "float64" }
+        };
+        for (int i = 0; i < 8; ++i)
+        {
+            if (typeName == names[i][0] || typeName == names[i][1])
+            {
+                *type = PlyType(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    struct plyProperty
+    {
+        string name;
+        PlyType type;
+        bool isList;
+        PlyType countType;      // type of the item count that starts a list
+    };
+
+    struct plyElement
+    {
+        string name;
+        unsigned long long count;
+        vector<plyProperty> properties;
+    };
+
+    // reads one value at a time from the body of a PLY file, keeping track
+    // of where it is for error messages
+    class plyReader
+    {
+        const char *m_data;     // start of the file
+        const char *m_p;
+        const char *m_value;    // start of the value last read
+        const char *m_end;
+        bool m_ascii;
+        bool m_swap;            // file byte order differs from this machine's
+        size_t m_line;          // of the value last read, in ASCII files
+
+    public:
+        plyReader(const char *data, const char *p, const char *end, bool ascii, bool swap,
+                  size_t line)
+            : m_data(data), m_p(p), m_value(p), m_end(end), m_ascii(ascii), m_swap(swap),
+              m_line(line)
+        {}
+
+        // bytes not read yet; every value takes at least one
+        size_t Remaining() const    { return size_t(m_end - m_p); }
+
+        // reports message at the line (ASCII) or byte offset (binary) of
+        // the value last read; always false
+        bool Error(const string &name, const char *message) const
+        {
+            if (m_ascii)
+                return importError(name, m_line, message);
+            cout << "ERROR: " << name << ": byte " << (m_value - m_data) << ": " << message << endl;
+            return false;
+        }
+
+        bool Read(PlyType type, double *value)
+        {
+            if (m_ascii)
+            {
+                for (; m_p < m_end && (isSpace(*m_p) || *m_p == '\n'); ++m_p)
+                    if (*m_p == '\n')
+                        ++m_line;
+                const char *word = m_value = m_p;
+                while (m_p < m_end && !isSpace(*m_p) && *m_p != '\n')
+                    ++m_p;
+
+                if (type == PLY_FLOAT32 || type == PLY_FLOAT64)
+                {
+                    float f;
+                    if (!parseFloat(word, m_p, &f))
+                        return false;
+                    *value = f;
+                    return true;
+                }
+                long long i;
+                if (!parseInteger(word, m_p, &i))
+                    return false;
+                *value = double(i);
+                return true;
+            }
+
+            static const size_t sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+            size_t size = sizes[type];
+            m_value = m_p;
+            if (size_t(m_end - m_p) < size)
+                return false;
+            unsigned char bytes[8];
+            memcpy(bytes, m_p, size);
+            m_p += size;
+            if (m_swap)
+                reverse(bytes, bytes + size);
+
+            switch (type)
+            {
+            case PLY_INT8:    { signed char v;    memcpy(&v, bytes, 1); *value = v; break; }
+            case PLY_UINT8:   { unsigned char v;  memcpy(&v, bytes, 1); *value = v; break; }
+            case PLY_INT16:   { short v;          memcpy(&v, bytes, 2); *value = v; break; }
+            case PLY_UINT16:  { unsigned short v; memcpy(&v, bytes, 2); *value = v; break; }
+            case PLY_INT32:   { int v;            memcpy(&v, bytes, 4); *value = v; break; }
+            case PLY_UINT32:  { unsigned int v;   memcpy(&v, bytes, 4); *value = v; break; }
+            case PLY_FLOAT32: { float v;          memcpy(&v, bytes, 4); *value = v; break; }
+            case PLY_FLOAT64: { double v;         memcpy(&v, bytes, 8); *value = v; break; }
+            }
+            return true;
+        }
+    };
+
+    bool importPly(const char *data, size_t size, const string &name,
+                   sceneData *scene, meshImportStats *stats)
+    {
+        // the header is a few lines of text ending in "end_header"
+        const char *marker = "end_header";
+        const char *headerEnd = search(data, data + size, marker, marker + strlen(marker));
+        if (headerEnd == data + size)
+            return importError(name, 1, "no end_header line");
+        const char *body = static_cast<const char *>(memchr(headerEnd, '\n', data + size - headerEnd));
+        body = body ? body + 1 : data + size;
+
+        istringstream header(string(data, headerEnd));
+        string line, format;
+        vector<plyElement> elements;
+        size_t lineNumber = 0;
+        while (getline(header, line))
+        {
+            ++lineNumber;
+            istringstream words(line);
+            string keyword;
+            words >> keyword;
+
+            if (lineNumber == 1 && keyword != "ply")
+                return importError(name, 1, "not a PLY file");
+            else if (keyword == "format")
+                words >> format;
+            else if (keyword == "element")
+            {
+                plyElement element;
+                if (!(words >> element.name >> element.count))
+                    return importError(name, lineNumber, "bad element line");
+                elements.push_back(element);
+            }
+            else if (keyword == "property")
+            {
+                plyProperty property;
+                string typeName, countTypeName;
+                words >> typeName;
+                property.isList = typeName == "list";
+                if (property.isList)
+                    words >> countTypeName >> typeName;
+                words >> property.name;
+                if (elements.empty() || !plyTypeFromName(typeName, &property.type) ||
+                    (property.isList && !plyTypeFromName(countTypeName, &property.countType)))
+                    return importError(name, lineNumber, "bad property line");
+                elements.back().properties.push_back(property);
+            }
+        }
+
+        unsigned int one = 1;
+        bool littleEndianHost = *reinterpret_cast<const char *>(&one) == 1;
+        bool ascii = format == "ascii";
+        if (!ascii && format != "binary_little_endian" && format != "binary_big_endian")
+            return importError(name, 2, "unknown format");
+        // the body starts on the line after end_header, itself the line
+        // after the last one read
+        plyReader reader(data, body, data + size, ascii,
+                         !ascii && (format == "binary_little_endian") != littleEndianHost,
+                         lineNumber + 2);
+
+        vector<vec3> &vertices = scene->meshVertices;
+        size_t firstVertex = vertices.size();
+        vector<unsigned int> polygon;
+        for (size_t e = 0; e < elements.size(); ++e)
+        {
+            const plyElement &element = elements[e];
+            bool isVertex = element.name == "vertex";
+            bool isFace = element.name == "face";
+            if (isVertex)
+                vertices.reserve(firstVertex + size_t(min(element.count, (unsigned long long)(size))));
+
+            for (unsigned long long i = 0; i < element.count; ++i)
+            {
+                vec3 position(0, 0, 0);
+                polygon.clear();
+
+                for (size_t k = 0; k < element.properties.size(); ++k)
+                {
+                    const plyProperty &property = element.properties[k];
+                    double value;
+                    if (!property.isList)
+                    {
+                        if (!reader.Read(property.type, &value))
+                            return reader.Error(name, "file ends early or holds a bad value");
+                        if (isVertex && property.name.size() == 1 && property.name[0] >= 'x' && property.name[0] <= 'z')
+                            position[property.name[0] - 'x'] = float(value);
+                        continue;
+                    }
+
+                    // a count can be any type, so it may be a fraction, a NaN
+                    // or far more items than the file has bytes left for
+                    double count;
+                    if (!reader.Read(property.countType, &count))
+                        return reader.Error(name, "file ends early or holds a bad list");
+                    if (!(count >= 0 && count <= double(reader.Remaining())) || count != floor(count))
+                        return reader.Error(name, "bad list count");
+                    bool isIndices = isFace && (property.name == "vertex_indices" || property.name == "vertex_index");
+                    for (size_t item = 0; item < size_t(count); ++item)
+                    {
+                        if (!reader.Read(property.type, &value))
+                            return reader.Error(name, "file ends early or holds a bad value");
+                        if (!isIndices)
+                            continue;
+                        if (value < 0 || value >= double(vertices.size() - firstVertex))
+                            return reader.Error(name, "vertex index out of range");
+                        polygon.push_back((unsigned int)(firstVertex + size_t(value)));
+                    }
+                }
+
+                if (isVertex)
+                    vertices.push_back(position);
+                if (isFace && polygon.size() >= 3)
+                {
+                    addPolygon(polygon, scene);
+                    ++stats->faces;
+                }
+            }
+        }
+
+        stats->vertices = vertices.size() - firstVertex;
+        return true;
+    }
+
+    bool hasExtension(const string &filename, const char *extension)
+    {
+        size_t length = strlen(extension);
+        if (filename.size() < length)
+            return false;
+        string tail = filename.substr(filename.size() - length);
+        transform(tail.begin(), tail.end(), tail.begin(), ::tolower);
+        return tail == extension;
+    }
+}
+
+// --------------------------------------------------------------------------
+
+bool importMesh(const string &filename, const vec3 &color, sceneData *scene,
+                meshImportStats *stats)
+{
+    auto start = chrono::high_resolution_clock::now();
+
+    meshImportStats result;
+    memset(&result, 0, sizeof(result));
+    size_t verticesBefore = scene->meshVertices.size();
+    size_t indicesBefore = scene->meshIndices.size();
+
+    MappedFile file;
+    if (!file.Open(filename))
+    {
+        cout << "ERROR: Could not open mesh file " << filename << endl;
+        return false;
+    }
+    result.bytes = file.Size();
+
+    bool imported;
+    if (hasExtension(filename, ".obj"))
+        imported = importObj(file.Data(), file.Size(), filename, scene, &result);
+    else if (hasExtension(filename, ".ply"))
+        imported = importPly(file.Data(), file.Size(), filename, scene, &result);
+    else
+    {
+        cout << "ERROR: " << filename << " is neither an .obj nor a .ply mesh" << endl;
+        imported = false;
+    }
+
+    result.triangles = (scene->meshIndices.size() - indicesBefore) / 3;
+    if (imported)
+    {
+        mesh m;
+        m.firstTriangle = int(indicesBefore / 3);
+        m.triangleCount = int(result.triangles);
+        m.color = color;
+        scene->meshes.push_back(m);
+    }
+    else
+    {
+        scene->meshVertices.resize(verticesBefore);
+        scene->meshIndices.resize(indicesBefore);
+    }
+    result.seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+    if (stats)
+        *stats = result;
+    return imported;
+}
+
+// --------------------------------------------------------------------------
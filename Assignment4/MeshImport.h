@@ -0,0 +1,33 @@
+// ==========================================================================
+// Mesh Import
+//  - streams Wavefront OBJ and Stanford PLY (ASCII or binary) meshes from
+//    a memory-mapped file into the indexed meshes of a scene
+//  - vertex positions go straight into the scene's vertex array, and faces
+//    are triangulated into its index array as they are reached
+// ==========================================================================
+#ifndef MESHIMPORT_H
+#define MESHIMPORT_H
+
+#include <cstddef>
+#include <string>
+#include <glm/glm.hpp>
+#include "SceneCache.h"
+
+// what one import read, and how long it took
+struct meshImportStats
+{
+    size_t bytes;
+    size_t vertices;
+    size_t faces;           // polygons in the file, before triangulation
+    size_t triangles;       // index triples appended to the scene
+    double seconds;
+};
+
+// appends an .obj or .ply file to scene as one mesh in the given colour,
+// splitting polygons into fans. Returns false, after printing why and
+// leaving the scene as it was, if the file cannot be read.
+bool importMesh(const std::string &filename, const glm::vec3 &color,
+                sceneData *scene, meshImportStats *stats = 0);
+
+// --------------------------------------------------------------------------
+#endif // MESHIMPORT_H
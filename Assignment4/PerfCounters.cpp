@@ -0,0 +1,221 @@
+// ==========================================================================
+// Hardware Performance Counters
+// ==========================================================================
+
+#include "PerfCounters.h"
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#if RENDER_PERF
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+bool perfEnabled = false;
+
+// --------------------------------------------------------------------------
+
+namespace
+{
+    // one thread's counter group, and what it has counted in each phase
+    struct perfThread
+    {
+        int leader;                             // group descriptor, -1 if none opened
+        int slot[PERF_COUNTER_COUNT];           // place in the group's read, -1 if not open
+        int phase;                              // being counted now, -1 for none
+        unsigned long long last[PERF_COUNTER_COUNT];
+        unsigned long long values[PERF_PHASE_COUNT][PERF_COUNTER_COUNT];
+    };
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+    __declspec(thread) perfThread *localPerf = 0;
+#else
+    thread_local perfThread *localPerf = 0;
+#endif
+
+    // every thread's counts, kept after it ends like the stats blocks
+    mutex registryLock;
+    vector<perfThread *> registry;
+
+    int openError = 0;      // errno of the last counter that would not open
+
+    const char *const CounterNames[] = { "cycles", "instructions", "cache_misses", "branch_misses" };
+    const char *const PhaseNames[] = { "load", "build", "primary", "shadow", "shade" };
+
+#if RENDER_PERF
+    const unsigned long long EventConfigs[] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    // user space events of the calling thread only, read all at once
+    // through the group leader; -1, with errno set, if it would not open
+    int openCounter(int counter, int leader)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = EventConfigs[counter];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        return int(syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0));
+    }
+#endif
+
+    perfThread *threadCounters()
+    {
+        if (localPerf)
+            return localPerf;
+
+        perfThread *counters = new perfThread;
+        memset(counters, 0, sizeof(perfThread));
+        counters->leader = -1;
+        counters->phase = -1;
+        for (int k = 0; k < PERF_COUNTER_COUNT; ++k)
+            counters->slot[k] = -1;
+#if RENDER_PERF
+        int members = 0;
+        for (int k = 0; k < PERF_COUNTER_COUNT; ++k)
+        {
+            int descriptor = openCounter(k, counters->leader);
+            if (descriptor < 0)
+            {
+                openError = errno;
+                continue;
+            }
+            if (counters->leader < 0)
+                counters->leader = descriptor;
+            counters->slot[k] = members++;
+        }
+#endif
+        localPerf = counters;
+        lock_guard<mutex> guard(registryLock);
+        registry.push_back(counters);
+        return counters;
+    }
+
+    // the group's running totals, in PerfCounter order
+    void readCounters(const perfThread *counters, unsigned long long *totals)
+    {
+#if RENDER_PERF
+        unsigned long long group[1 + PERF_COUNTER_COUNT];
+        if (read(counters->leader, group, sizeof(group)) <= 0)
+            return;
+        for (int k = 0; k < PERF_COUNTER_COUNT; ++k)
+            totals[k] = counters->slot[k] < 0 ? 0 : group[1 + counters->slot[k]];
+#endif
+    }
+
+    // charges what the counters advanced since they were last read to the
+    // phase being counted
+    void charge(perfThread *counters)
+    {
+        unsigned long long now[PERF_COUNTER_COUNT];
+        memcpy(now, counters->last, sizeof(now));
+        readCounters(counters, now);
+        if (counters->phase >= 0)
+        {
+            for (int k = 0; k < PERF_COUNTER_COUNT; ++k)
+                counters->values[counters->phase][k] += now[k] - counters->last[k];
+        }
+        memcpy(counters->last, now, sizeof(now));
+    }
+}
+
+// --------------------------------------------------------------------------
+
+bool startPerfCounters()
+{
+#if RENDER_PERF
+    // the calling thread's group stands in for everyone's: if it has no
+    // counters, no thread will
+    perfThread *counters = threadCounters();
+    if (counters->leader < 0)
+    {
+        cout << "perf counters unavailable (" << strerror(openError)
+             << "); check perf_event_paranoid, or run outside a container or VM" << endl;
+        return false;
+    }
+    perfEnabled = true;
+    return true;
+#else
+    cout << "perf counters are not built in; they need Linux and RENDER_PERF" << endl;
+    return false;
+#endif
+}
+
+int PerfScope::Enter(int phase)
+{
+    perfThread *counters = threadCounters();
+    if (counters->leader < 0)
+        return -1;
+    charge(counters);
+    int outer = counters->phase;
+    counters->phase = phase;
+    return outer;
+}
+
+void PerfScope::Leave(int outer)
+{
+    perfThread *counters = threadCounters();
+    if (counters->leader < 0)
+        return;
+    charge(counters);
+    counters->phase = outer;
+}
+
+// --------------------------------------------------------------------------
+
+perfCounts collectPerfCounters()
+{
+    perfCounts total;
+    memset(&total, 0, sizeof(total));
+    lock_guard<mutex> guard(registryLock);
+    for (size_t i = 0; i < registry.size(); ++i)
+    {
+        for (int p = 0; p < PERF_PHASE_COUNT; ++p)
+            for (int k = 0; k < PERF_COUNTER_COUNT; ++k)
+                total.values[p][k] += registry[i]->values[p][k];
+        for (int k = 0; k < PERF_COUNTER_COUNT; ++k)
+            total.counted[k] |= registry[i]->slot[k] >= 0;
+    }
+    return total;
+}
+
+void resetPerfCounters()
+{
+    lock_guard<mutex> guard(registryLock);
+    for (size_t i = 0; i < registry.size(); ++i)
+        memset(registry[i]->values, 0, sizeof(registry[i]->values));
+}
+
+void printPerfCounters(ostream &out, const perfCounts &counts)
+{
+    out << "hardware counters (user space, all threads)" << endl;
+    for (int p = 0; p < PERF_PHASE_COUNT; ++p)
+    {
+        const unsigned long long *values = counts.values[p];
+        out << "  " << PhaseNames[p] << ":";
+        for (int k = 0; k < PERF_COUNTER_COUNT; ++k)
+        {
+            out << " " << CounterNames[k] << " ";
+            if (counts.counted[k])
+                out << values[k];
+            else
+                out << "n/a";
+        }
+        if (counts.counted[PERF_CYCLES] && counts.counted[PERF_INSTRUCTIONS] && values[PERF_CYCLES] > 0)
+            out << " ipc " << double(values[PERF_INSTRUCTIONS]) / values[PERF_CYCLES];
+        out << endl;
+    }
+}
+
+// --------------------------------------------------------------------------
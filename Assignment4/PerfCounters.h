@@ -0,0 +1,91 @@
+// ==========================================================================
+// Hardware Performance Counters
+//  - counts cycles, instructions, cache misses and branch misses per phase
+//    of a frame (load, build, primary rays, shadow rays, shading) through
+//    Linux perf_event_open, one counter group per thread
+//  - counters are read with a system call at every phase boundary, a few
+//    times per packet, so --perf slows rendering; it is for comparing
+//    layouts, not for timing them
+//  - where counters cannot be opened (other systems, containers, VMs,
+//    perf_event_paranoid) the report says so and rendering carries on
+// ==========================================================================
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <iosfwd>
+
+#ifndef RENDER_PERF
+#if defined(__linux__)
+#define RENDER_PERF 1
+#else
+#define RENDER_PERF 0
+#endif
+#endif
+
+enum PerfCounter
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,          // last level cache
+    PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+};
+
+enum PerfPhase
+{
+    PERF_LOAD,
+    PERF_BUILD,
+    PERF_PRIMARY,
+    PERF_SHADOW,
+    PERF_SHADE,
+    PERF_PHASE_COUNT
+};
+
+struct perfCounts
+{
+    unsigned long long values[PERF_PHASE_COUNT][PERF_COUNTER_COUNT];
+    bool counted[PERF_COUNTER_COUNT];   // false where the counter would not open
+};
+
+// set by startPerfCounters(), before any thread counts; read-only afterwards
+extern bool perfEnabled;
+
+// turns counting on; false, with a message, if this system has no counters
+bool startPerfCounters();
+
+// the sum of every thread's counts since the last reset, and clearing
+// them; call them only while nothing is counting, e.g. between frames
+perfCounts collectPerfCounters();
+void resetPerfCounters();
+
+void printPerfCounters(std::ostream &out, const perfCounts &counts);
+
+// what the calling thread's counters advance by from construction to
+// destruction goes to phase; a scope opened inside another takes its share
+// away from the outer one, so each event is counted in one phase only
+class PerfScope
+{
+    int m_outer;
+
+public:
+    explicit PerfScope(PerfPhase phase) : m_outer(-1)
+    {
+        if (perfEnabled) m_outer = Enter(phase);
+    }
+    ~PerfScope()
+    {
+        if (perfEnabled) Leave(m_outer);
+    }
+
+    static int Enter(int phase);
+    static void Leave(int outer);
+};
+
+#if RENDER_PERF
+#define PERF_SCOPE(phase)   PerfScope perfScope##phase(phase)
+#else
+#define PERF_SCOPE(phase)   ((void)0)
+#endif
+
+// --------------------------------------------------------------------------
+#endif // PERFCOUNTERS_H
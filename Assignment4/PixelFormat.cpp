@@ -0,0 +1,225 @@
+// ==========================================================================
+// Framebuffer Pixel Formats
+// ==========================================================================
+
+#include "PixelFormat.h"
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace glm;
+
+// --------------------------------------------------------------------------
+
+namespace
+{
+    unsigned int floatBits(float value)
+    {
+        unsigned int bits;
+        memcpy(&bits, &value, 4);
+        return bits;
+    }
+
+    float bitsFloat(unsigned int bits)
+    {
+        float value;
+        memcpy(&value, &bits, 4);
+        return value;
+    }
+
+    // clamps to [0, limit], sending NaN to 0 as well
+    float clampNonNegative(float value, float limit)
+    {
+        return value > 0.f ? (value < limit ? value : limit) : 0.f;
+    }
+
+    const char *const FormatNames[] = { "rgb32f", "rgb16f", "rgb9e5", "rgba8" };
+}
+
+// --------------------------------------------------------------------------
+
+unsigned short floatToHalf(float value)
+{
+    unsigned int bits = floatBits(value);
+    unsigned int sign = (bits >> 16) & 0x8000;
+    bits &= 0x7fffffff;
+
+    unsigned int half;
+    if (bits >= (127 + 16) << 23)
+    {
+        // too large for a half: infinity, or a quiet NaN for a NaN
+        half = bits > 0x7f800000 ? 0x7e00 : 0x7c00;
+    }
+    else if (bits < (127 - 14) << 23)
+    {
+        // below the smallest normal half: adding a float whose exponent
+        // puts its last mantissa bit at the half subnormal step lets the
+        // FPU do the rounding
+        const float magic = bitsFloat(((127 - 15) + (23 - 10) + 1) << 23);
+        half = floatBits(bitsFloat(bits) + magic) - floatBits(magic);
+    }
+    else
+    {
+        // rebias the exponent and round the 13 dropped bits to nearest even
+        unsigned int odd = (bits >> 13) & 1;
+        bits -= unsigned(127 - 15) << 23;
+        bits += 0xfffu + odd;
+        half = bits >> 13;
+    }
+    return (unsigned short)(half | sign);
+}
+
+float halfToFloat(unsigned short half)
+{
+    unsigned int bits = (half & 0x7fffu) << 13;
+    unsigned int exponent = bits & (0x7c00u << 13);
+    bits += (127 - 15) << 23;
+    if (exponent == 0x7c00u << 13)
+        bits += (128 - 16) << 23;                       // infinity or NaN
+    else if (exponent == 0)
+    {
+        // subnormal: renormalised by the FPU
+        bits += 1 << 23;
+        bits = floatBits(bitsFloat(bits) - bitsFloat(113 << 23));
+    }
+    return bitsFloat(bits | (unsigned int)(half & 0x8000u) << 16);
+}
+
+// --------------------------------------------------------------------------
+
+unsigned int packRGB9E5(const vec3 &colour)
+{
+    const int MantissaBits = 9, Bias = 15, MaxExponent = 31;
+    const float MaxValue = float(511.0 / 512.0 * (1 << (MaxExponent - Bias)));
+
+    float r = clampNonNegative(colour.r, MaxValue);
+    float g = clampNonNegative(colour.g, MaxValue);
+    float b = clampNonNegative(colour.b, MaxValue);
+    float largest = r > g ? (r > b ? r : b) : (g > b ? g : b);
+
+    // the exponent that fits the largest channel, one step up if rounding
+    // its mantissa carries out of 9 bits
+    int exponent = -Bias - 1;
+    if (largest > 0.f)
+    {
+        int e;
+        frexp(largest, &e);                 // largest = m * 2^e, m in [0.5, 1)
+        exponent = e - 1 > exponent ? e - 1 : exponent;
+    }
+    exponent += 1 + Bias;
+    float scale = float(ldexp(1.0, MantissaBits + Bias - exponent));
+    if (int(largest * scale + 0.5f) == 1 << MantissaBits)
+    {
+        scale *= 0.5f;
+        ++exponent;
+    }
+
+    unsigned int red = unsigned(r * scale + 0.5f);
+    unsigned int green = unsigned(g * scale + 0.5f);
+    unsigned int blue = unsigned(b * scale + 0.5f);
+    return red | green << 9 | blue << 18 | unsigned(exponent) << 27;
+}
+
+vec3 unpackRGB9E5(unsigned int packed)
+{
+    float scale = float(ldexp(1.0, int(packed >> 27) - 15 - 9));
+    return vec3(float(packed & 511), float(packed >> 9 & 511), float(packed >> 18 & 511)) * scale;
+}
+
+// --------------------------------------------------------------------------
+
+int pixelFormatBytes(PixelFormat format)
+{
+    switch (format)
+    {
+    case RGB16F_FORMAT: return 6;
+    case RGB9E5_FORMAT: return 4;
+    case RGBA8_FORMAT:  return 4;
+    default:            return sizeof(vec3);
+    }
+}
+
+void packPixels(PixelFormat format, const vec3 *colours, int count, unsigned char *bytes)
+{
+    switch (format)
+    {
+    case RGB16F_FORMAT:
+        for (int i = 0; i < count; ++i, bytes += 6)
+        {
+            unsigned short half[3] = { floatToHalf(clampNonNegative(colours[i].r, 65504.f)),
+                                       floatToHalf(clampNonNegative(colours[i].g, 65504.f)),
+                                       floatToHalf(clampNonNegative(colours[i].b, 65504.f)) };
+            memcpy(bytes, half, 6);
+        }
+        break;
+    case RGB9E5_FORMAT:
+        for (int i = 0; i < count; ++i, bytes += 4)
+        {
+            unsigned int packed = packRGB9E5(colours[i]);
+            memcpy(bytes, &packed, 4);
+        }
+        break;
+    case RGBA8_FORMAT:
+        for (int i = 0; i < count; ++i, bytes += 4)
+        {
+            bytes[0] = (unsigned char)(clampNonNegative(colours[i].r, 1.f) * 255.f + 0.5f);
+            bytes[1] = (unsigned char)(clampNonNegative(colours[i].g, 1.f) * 255.f + 0.5f);
+            bytes[2] = (unsigned char)(clampNonNegative(colours[i].b, 1.f) * 255.f + 0.5f);
+            bytes[3] = 255;
+        }
+        break;
+    default:
+        memcpy(bytes, colours, count * sizeof(vec3));
+        break;
+    }
+}
+
+void unpackPixels(PixelFormat format, const unsigned char *bytes, int count, vec3 *colours)
+{
+    switch (format)
+    {
+    case RGB16F_FORMAT:
+        for (int i = 0; i < count; ++i, bytes += 6)
+        {
+            unsigned short half[3];
+            memcpy(half, bytes, 6);
+            colours[i] = vec3(halfToFloat(half[0]), halfToFloat(half[1]), halfToFloat(half[2]));
+        }
+        break;
+    case RGB9E5_FORMAT:
+        for (int i = 0; i < count; ++i, bytes += 4)
+        {
+            unsigned int packed;
+            memcpy(&packed, bytes, 4);
+            colours[i] = unpackRGB9E5(packed);
+        }
+        break;
+    case RGBA8_FORMAT:
+        for (int i = 0; i < count; ++i, bytes += 4)
+            colours[i] = vec3(bytes[0], bytes[1], bytes[2]) * (1.f / 255.f);
+        break;
+    default:
+        memcpy(colours, bytes, count * sizeof(vec3));
+        break;
+    }
+}
+
+// --------------------------------------------------------------------------
+
+const char *pixelFormatName(PixelFormat format)
+{
+    return FormatNames[format];
+}
+
+bool parsePixelFormat(const string &name, PixelFormat *format)
+{
+    for (int i = 0; i < 4; ++i)
+        if (name == FormatNames[i])
+        {
+            *format = PixelFormat(i);
+            return true;
+        }
+    return false;
+}
+
+// --------------------------------------------------------------------------
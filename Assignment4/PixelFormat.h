@@ -0,0 +1,44 @@
+// ==========================================================================
+// Framebuffer Pixel Formats
+//  - the ways an ImageBuffer can store its colours: full floats, or
+//    smaller encodings that let very large images fit in memory
+//  - colours are packed when written and unpacked when read, so rendering
+//    and shading always see plain floats
+// ==========================================================================
+#ifndef PIXELFORMAT_H
+#define PIXELFORMAT_H
+
+#include <string>
+#include <glm/vec3.hpp>
+
+enum PixelFormat
+{
+    RGB32F_FORMAT,      // 12 bytes: floats, exactly as rendered
+    RGB16F_FORMAT,      // 6 bytes: half floats, 11 significant bits
+    RGB9E5_FORMAT,      // 4 bytes: 9-bit mantissas sharing one exponent
+    RGBA8_FORMAT        // 4 bytes: [0, 1] in 256 linear steps, opaque alpha
+};
+
+// bytes one pixel takes in format
+int pixelFormatBytes(PixelFormat format);
+
+// converts count colours to or from format; negative and NaN values become
+// 0 in every format but RGB32F, and RGBA8 also clamps to 1
+void packPixels(PixelFormat format, const glm::vec3 *colours, int count, unsigned char *bytes);
+void unpackPixels(PixelFormat format, const unsigned char *bytes, int count, glm::vec3 *colours);
+
+// half float conversion, rounding to nearest even
+unsigned short floatToHalf(float value);
+float halfToFloat(unsigned short half);
+
+// shared exponent conversion, as OpenGL's GL_RGB9_E5 defines it
+unsigned int packRGB9E5(const glm::vec3 &colour);
+glm::vec3 unpackRGB9E5(unsigned int packed);
+
+const char *pixelFormatName(PixelFormat format);
+
+// accepts the names pixelFormatName() returns
+bool parsePixelFormat(const std::string &name, PixelFormat *format);
+
+// --------------------------------------------------------------------------
+#endif // PIXELFORMAT_H
@@ -0,0 +1,107 @@
+// ==========================================================================
+// Pixel Traversal Order
+// ==========================================================================
+
+#include "PixelOrder.h"
+
+using namespace std;
+
+// --------------------------------------------------------------------------
+
+namespace
+{
+    // every other bit of v, packed down into the low half
+    unsigned int compactBits(unsigned int v)
+    {
+        v &= 0x55555555;
+        v = (v | (v >> 1)) & 0x33333333;
+        v = (v | (v >> 2)) & 0x0f0f0f0f;
+        v = (v | (v >> 4)) & 0x00ff00ff;
+        v = (v | (v >> 8)) & 0x0000ffff;
+        return v;
+    }
+
+    const char *const OrderNames[] = { "scanline", "morton", "hilbert" };
+}
+
+void mortonCell(unsigned int d, int *x, int *y)
+{
+    *x = int(compactBits(d));
+    *y = int(compactBits(d >> 1));
+}
+
+void hilbertCell(int size, int d, int *x, int *y)
+{
+    // walks up from the smallest quadrants, rotating the partial result
+    // into place each time a quadrant is entered flipped
+    int px = 0, py = 0;
+    for (int s = 1; s < size; s *= 2)
+    {
+        int rx = 1 & (d / 2);
+        int ry = 1 & (d ^ rx);
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                px = s - 1 - px;
+                py = s - 1 - py;
+            }
+            int t = px;
+            px = py;
+            py = t;
+        }
+        px += s * rx;
+        py += s * ry;
+        d /= 4;
+    }
+    *x = px;
+    *y = py;
+}
+
+// --------------------------------------------------------------------------
+
+void traversalOrder(PixelOrder order, int width, int height, vector<int> *cells)
+{
+    cells->clear();
+    cells->reserve(width * height);
+
+    if (order == SCANLINE_ORDER)
+    {
+        for (int i = 0; i < width * height; ++i)
+            cells->push_back(i);
+        return;
+    }
+
+    int size = 1;
+    while (size < width || size < height)
+        size *= 2;
+
+    for (int d = 0; d < size * size; ++d)
+    {
+        int x, y;
+        if (order == MORTON_ORDER)
+            mortonCell(d, &x, &y);
+        else
+            hilbertCell(size, d, &x, &y);
+        if (x < width && y < height)
+            cells->push_back(y * width + x);
+    }
+}
+
+const char *pixelOrderName(PixelOrder order)
+{
+    return OrderNames[order];
+}
+
+bool parsePixelOrder(const string &name, PixelOrder *order)
+{
+    for (int i = 0; i < 3; ++i)
+        if (name == OrderNames[i])
+        {
+            *order = PixelOrder(i);
+            return true;
+        }
+    return false;
+}
+
+// --------------------------------------------------------------------------
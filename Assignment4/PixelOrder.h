@@ -0,0 +1,36 @@
+// ==========================================================================
+// Pixel Traversal Order
+//  - space-filling curves that visit a grid of pixels, packets or tiles so
+//    that consecutive cells are neighbours in the image: their rays take
+//    the same way through the BVH and their writes land in the same cache
+//    lines of the ImageBuffer
+// ==========================================================================
+#ifndef PIXELORDER_H
+#define PIXELORDER_H
+
+#include <string>
+#include <vector>
+
+enum PixelOrder
+{
+    SCANLINE_ORDER,     // row by row, left to right
+    MORTON_ORDER,       // Z-order: recursive quadrants, with jumps between them
+    HILBERT_ORDER       // recursive quadrants, always stepping to a neighbour
+};
+
+// the cell at position d along a curve over a 2^k x 2^k grid
+void mortonCell(unsigned int d, int *x, int *y);
+void hilbertCell(int size, int d, int *x, int *y);
+
+// fills cells with every cell of a width x height grid, as y * width + x, in
+// the given order; curves are walked over the enclosing power of two square
+// and the cells outside the grid skipped
+void traversalOrder(PixelOrder order, int width, int height, std::vector<int> *cells);
+
+const char *pixelOrderName(PixelOrder order);
+
+// accepts the names pixelOrderName() returns
+bool parsePixelOrder(const std::string &name, PixelOrder *order);
+
+// --------------------------------------------------------------------------
+#endif // PIXELORDER_H
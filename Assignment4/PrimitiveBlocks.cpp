@@ -0,0 +1,99 @@
+// ==========================================================================
+// Primitive Blocks
+//  - the kernels themselves are in KernelTemplates.h, built for each
+//    instruction set and picked at startup by KernelDispatch.cpp
+// ==========================================================================
+
+#include "PrimitiveBlocks.h"
+#include "KernelDispatch.h"
+#include "RenderStats.h"
+#include <limits>
+
+using namespace glm;
+
+// --------------------------------------------------------------------------
+
+void clearBlock(triangleBlock *block)
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (int lane = 0; lane < BlockWidth; ++lane)
+        {
+            block->P0[axis][lane] = 0.f;
+            block->e1[axis][lane] = 0.f;
+            block->e2[axis][lane] = 0.f;
+        }
+    }
+    for (int lane = 0; lane < BlockWidth; ++lane)
+    {
+        block->primitive[lane].type = TRIANGLE_PRIMITIVE;
+        block->primitive[lane].index = -1;
+    }
+}
+
+void clearBlock(sphereBlock *block)
+{
+    // c = |oc|^2 + infinity keeps the discriminant negative
+    for (int lane = 0; lane < BlockWidth; ++lane)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+            block->center[axis][lane] = 0.f;
+        block->radiusSquared[lane] = -std::numeric_limits<float>::infinity();
+        block->primitive[lane].type = SPHERE_PRIMITIVE;
+        block->primitive[lane].index = -1;
+    }
+}
+
+void setLane(triangleBlock *block, int lane, const vec3 &P0, const vec3 &P1,
+             const vec3 &P2, const primitiveRef &p)
+{
+    vec3 e1 = P1 - P0, e2 = P2 - P0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        block->P0[axis][lane] = P0[axis];
+        block->e1[axis][lane] = e1[axis];
+        block->e2[axis][lane] = e2[axis];
+    }
+    block->primitive[lane] = p;
+}
+
+void setLane(sphereBlock *block, int lane, const vec3 &center, float radiusSquared,
+             const primitiveRef &p)
+{
+    for (int axis = 0; axis < 3; ++axis)
+        block->center[axis][lane] = center[axis];
+    block->radiusSquared[lane] = radiusSquared;
+    block->primitive[lane] = p;
+}
+
+// --------------------------------------------------------------------------
+
+bool closestHitBlocks(const triangleBlock *blocks, int count, const ray &r,
+                      float tMin, float *tMax, primitiveRef *hit)
+{
+    STAT_ADD(STAT_TRIANGLE_BLOCKS, count);
+    return activeKernels.closestHitTriangles(blocks, count, r, tMin, tMax, hit);
+}
+
+bool closestHitBlocks(const sphereBlock *blocks, int count, const ray &r,
+                      float tMin, float *tMax, primitiveRef *hit)
+{
+    STAT_ADD(STAT_SPHERE_BLOCKS, count);
+    return activeKernels.closestHitSpheres(blocks, count, r, tMin, tMax, hit);
+}
+
+bool anyHitBlocks(const triangleBlock *blocks, int count, const ray &r,
+                  float tMin, float tMax)
+{
+    STAT_ADD(STAT_TRIANGLE_BLOCKS, count);
+    return activeKernels.anyHitTriangles(blocks, count, r, tMin, tMax);
+}
+
+bool anyHitBlocks(const sphereBlock *blocks, int count, const ray &r,
+                  float tMin, float tMax)
+{
+    STAT_ADD(STAT_SPHERE_BLOCKS, count);
+    return activeKernels.anyHitSpheres(blocks, count, r, tMin, tMax);
+}
+
+// --------------------------------------------------------------------------
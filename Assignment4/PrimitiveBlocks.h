@@ -0,0 +1,58 @@
+// ==========================================================================
+// Primitive Blocks
+//  - spheres and triangles packed BlockWidth at a time as structure-of-
+//    arrays blocks, so one ray can be tested against a whole block at once
+//  - the kernels use the widest vector instructions the CPU has (AVX-512,
+//    AVX2, SSE4.2 or SSE2), as chosen by KernelDispatch.h
+// ==========================================================================
+#ifndef PRIMITIVEBLOCKS_H
+#define PRIMITIVEBLOCKS_H
+
+#include <glm/glm.hpp>
+#include "Scene.h"
+
+// primitives per block; AVX-512 takes two blocks per instruction
+const int BlockWidth = 8;
+
+// Each coordinate is stored as BlockWidth consecutive floats, one per lane.
+// Unused lanes are left as clearBlock() made them and never report a hit.
+
+struct triangleBlock
+{
+    float P0[3][BlockWidth];
+    float e1[3][BlockWidth];        // P1 - P0
+    float e2[3][BlockWidth];        // P2 - P0
+    primitiveRef primitive[BlockWidth];
+};
+
+struct sphereBlock
+{
+    float center[3][BlockWidth];
+    float radiusSquared[BlockWidth];
+    primitiveRef primitive[BlockWidth];
+};
+
+void clearBlock(triangleBlock *block);
+void clearBlock(sphereBlock *block);
+
+void setLane(triangleBlock *block, int lane, const glm::vec3 &P0,
+             const glm::vec3 &P1, const glm::vec3 &P2, const primitiveRef &p);
+void setLane(sphereBlock *block, int lane, const glm::vec3 &center,
+             float radiusSquared, const primitiveRef &p);
+
+// Tests r against count consecutive blocks. The closestHit forms find the
+// nearest hit in (tMin, *tMax), and on finding one lower *tMax to it, set
+// *hit and return true; the anyHit forms stop at the first hit in
+// (tMin, tMax). Triangles are tested with Moller-Trumbore, like mesh
+// triangles outside the blocks.
+bool closestHitBlocks(const triangleBlock *blocks, int count, const ray &r,
+                      float tMin, float *tMax, primitiveRef *hit);
+bool closestHitBlocks(const sphereBlock *blocks, int count, const ray &r,
+                      float tMin, float *tMax, primitiveRef *hit);
+bool anyHitBlocks(const triangleBlock *blocks, int count, const ray &r,
+                  float tMin, float tMax);
+bool anyHitBlocks(const sphereBlock *blocks, int count, const ray &r,
+                  float tMin, float tMax);
+
+// --------------------------------------------------------------------------
+#endif // PRIMITIVEBLOCKS_H
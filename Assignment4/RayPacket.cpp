@@ -0,0 +1,88 @@
+// ==========================================================================
+// Ray Packets
+// ==========================================================================
+
+#include "RayPacket.h"
+#include "KernelDispatch.h"
+#include <limits>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace glm;
+
+// --------------------------------------------------------------------------
+
+void setRay(rayPacket *packet, int lane, const ray &r)
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        packet->origin[axis][lane] = r.origin[axis];
+        packet->direction[axis][lane] = r.direction[axis];
+        packet->invDirection[axis][lane] = 1.f / r.direction[axis];
+    }
+    packet->rays[lane] = r;
+}
+
+packetMask packetBoxHits(const rayPacket &packet, packetMask active,
+                         const float *tMax, const vec3 &lower,
+                         const vec3 &upper, float *nearest)
+{
+    *nearest = std::numeric_limits<float>::infinity();
+    return activeKernels.boxHits(packet, active, tMax, lower, upper, nearest);
+}
+
+int firstLane(packetMask mask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long lane;
+    _BitScanForward64(&lane, mask);
+    return int(lane);
+#elif defined(__GNUC__)
+    return __builtin_ctzll(mask);
+#else
+    int lane = 0;
+    while (!(mask & 1))
+    {
+        mask >>= 1;
+        ++lane;
+    }
+    return lane;
+#endif
+}
+
+// no popcnt intrinsic on MSVC: the baseline build must run on CPUs without it
+int laneCount(packetMask mask)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(mask);
+#else
+    int count = 0;
+    for (; mask; mask &= mask - 1)
+        ++count;
+    return count;
+#endif
+}
+
+// --------------------------------------------------------------------------
+
+void setShading(shadingPacket *packet, int lane, const vec3 &point, const vec3 &normal,
+                const vec3 &eye, const vec3 &base, bool specular, float ambient)
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        packet->point[axis][lane] = point[axis];
+        packet->normal[axis][lane] = normal[axis];
+        packet->eye[axis][lane] = eye[axis];
+        packet->base[axis][lane] = base[axis];
+        packet->color[axis][lane] = base[axis] * ambient;
+    }
+    packet->specular[lane] = specular ? 1.f : 0.f;
+}
+
+vec3 shadedColor(const shadingPacket &packet, int lane)
+{
+    return vec3(packet.color[0][lane], packet.color[1][lane], packet.color[2][lane]);
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,67 @@
+// ==========================================================================
+// Ray Packets
+//  - up to PacketSize rays stored as structure-of-arrays, so a bounding box
+//    can be tested against the whole packet with SIMD instructions and the
+//    BVH walked once for all of them
+//  - sized for a PacketWidth x PacketWidth block of neighbouring pixels,
+//    whose camera rays are nearly parallel and so visit much the same nodes
+//  - the points they hit are shaded as a packet too
+// ==========================================================================
+#ifndef RAYPACKET_H
+#define RAYPACKET_H
+
+#include <glm/glm.hpp>
+#include "Scene.h"
+
+const int PacketWidth = 8;
+const int PacketSize = PacketWidth * PacketWidth;
+
+// one bit per ray of a packet, ray i in bit i
+typedef unsigned long long packetMask;
+
+struct rayPacket
+{
+    float origin[3][PacketSize];
+    float direction[3][PacketSize];
+    float invDirection[3][PacketSize];
+    ray rays[PacketSize];               // the same rays, one at a time
+};
+
+// stores r as ray lane of the packet
+void setRay(rayPacket *packet, int lane, const ray &r);
+
+// the rays of active whose segment [0, tMax[lane]] passes through the box
+// from lower to upper; *nearest is set to the smallest distance at which
+// one of them enters it
+packetMask packetBoxHits(const rayPacket &packet, packetMask active,
+                         const float *tMax, const glm::vec3 &lower,
+                         const glm::vec3 &upper, float *nearest);
+
+// index of the lowest set bit of a non-zero mask
+int firstLane(packetMask mask);
+
+// number of set bits, i.e. of rays in the mask
+int laneCount(packetMask mask);
+
+// the points a packet of rays hit, lit a light at a time by the phong kernel
+// of KernelDispatch.h, which adds to color
+struct shadingPacket
+{
+    float point[3][PacketSize];
+    float normal[3][PacketSize];
+    float eye[3][PacketSize];           // where the ray came from
+    float base[3][PacketSize];          // diffuse colour
+    float specular[PacketSize];         // 1 for a highlight, 0 for none
+    float color[3][PacketSize];
+};
+
+// stores a hit point as lane of the packet, lit only by ambient light of
+// the given intensity so far
+void setShading(shadingPacket *packet, int lane, const glm::vec3 &point,
+                const glm::vec3 &normal, const glm::vec3 &eye,
+                const glm::vec3 &base, bool specular, float ambient);
+
+glm::vec3 shadedColor(const shadingPacket &packet, int lane);
+
+// --------------------------------------------------------------------------
+#endif // RAYPACKET_H
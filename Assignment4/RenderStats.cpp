@@ -0,0 +1,140 @@
+// ==========================================================================
+// Render Statistics
+// ==========================================================================
+
+#include "RenderStats.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+// --------------------------------------------------------------------------
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+__declspec(thread) renderStats *localStats = 0;
+#else
+thread_local renderStats *localStats = 0;
+#endif
+
+namespace
+{
+    // every block ever made; they outlive their threads, so what a thread
+    // counted before its scheduler was destroyed still adds up
+    mutex registryLock;
+    vector<renderStats *> registry;
+
+    // the tick rate is the ticks over the seconds since startup
+    const chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+    const unsigned long long startTicks = statTicks();
+
+    const char *const CounterNames[] = {
+        "primary_rays", "shadow_rays", "sphere_tests", "plane_tests", "triangle_tests",
+        "mesh_triangle_tests", "sphere_blocks", "triangle_blocks", "bvh_nodes", "shaded_points"
+    };
+    const char *const PhaseNames[] = { "parse", "build", "trace", "shade", "upload", "save" };
+}
+
+// --------------------------------------------------------------------------
+
+renderStats *newThreadStats()
+{
+    localStats = new renderStats;
+    memset(localStats, 0, sizeof(renderStats));
+    lock_guard<mutex> guard(registryLock);
+    registry.push_back(localStats);
+    return localStats;
+}
+
+renderStats collectStats()
+{
+    renderStats total;
+    memset(&total, 0, sizeof(total));
+    lock_guard<mutex> guard(registryLock);
+    for (size_t i = 0; i < registry.size(); ++i)
+    {
+        for (int k = 0; k < STAT_COUNTER_COUNT; ++k)
+            total.counts[k] += registry[i]->counts[k];
+        for (int k = 0; k < STAT_PHASE_COUNT; ++k)
+            total.ticks[k] += registry[i]->ticks[k];
+    }
+    return total;
+}
+
+double ticksPerSecond()
+{
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    return seconds > 0 ? (statTicks() - startTicks) / seconds : 1.0e9;
+}
+
+void resetStats()
+{
+    lock_guard<mutex> guard(registryLock);
+    for (size_t i = 0; i < registry.size(); ++i)
+        memset(registry[i], 0, sizeof(renderStats));
+}
+
+// --------------------------------------------------------------------------
+
+const char *costMeasureName(CostMeasure measure)
+{
+    switch (measure)
+    {
+    case CYCLE_COST: return "cycles";
+    case TEST_COST: return "tests";
+    default: return "none";
+    }
+}
+
+bool parseCostMeasure(const string &name, CostMeasure *measure)
+{
+    for (int k = NO_COST; k <= TEST_COST; ++k)
+    {
+        if (name == costMeasureName(CostMeasure(k)))
+        {
+            *measure = CostMeasure(k);
+            return true;
+        }
+    }
+    return false;
+}
+
+// --------------------------------------------------------------------------
+
+void printStats(ostream &out, const renderStats &stats, double frameSeconds)
+{
+    double tickSeconds = 1.0 / ticksPerSecond();
+    double rays = double(stats.counts[STAT_PRIMARY_RAYS] + stats.counts[STAT_SHADOW_RAYS]);
+    out << "render statistics (" << frameSeconds * 1000.0 << " ms frame";
+    if (frameSeconds > 0)
+        out << ", " << rays / frameSeconds / 1.0e6 << " Mrays/s";
+    out << ")" << endl;
+    for (int k = 0; k < STAT_COUNTER_COUNT; ++k)
+    {
+        out << "  " << CounterNames[k] << ": " << stats.counts[k];
+        if (k != STAT_PRIMARY_RAYS && stats.counts[STAT_PRIMARY_RAYS] > 0)
+            out << " (" << double(stats.counts[k]) / stats.counts[STAT_PRIMARY_RAYS] << " per pixel)";
+        out << endl;
+    }
+    for (int k = 0; k < STAT_PHASE_COUNT; ++k)
+        out << "  " << PhaseNames[k] << "_ms: " << stats.ticks[k] * tickSeconds * 1000.0 << endl;
+#if !RENDER_STATS
+    out << "  (counters were compiled out with RENDER_STATS=0)" << endl;
+#endif
+}
+
+void writeStatsJson(ostream &out, const renderStats &stats, double frameSeconds)
+{
+    double tickSeconds = 1.0 / ticksPerSecond();
+    out << "{ \"frame_ms\": " << frameSeconds * 1000.0 << ", \"counters\": {";
+    for (int k = 0; k < STAT_COUNTER_COUNT; ++k)
+        out << (k ? ", \"" : " \"") << CounterNames[k] << "\": " << stats.counts[k];
+    out << " }, \"phase_ms\": {";
+    for (int k = 0; k < STAT_PHASE_COUNT; ++k)
+        out << (k ? ", \"" : " \"") << PhaseNames[k] << "\": " << stats.ticks[k] * tickSeconds * 1000.0;
+    out << " } }" << endl;
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,143 @@
+// ==========================================================================
+// Render Statistics
+//  - counts what a frame did (rays, intersection tests, BVH nodes, shading)
+//    and how long each phase took, in per-thread blocks that are summed once
+//    the frame is done, so the hot paths never share a cache line
+//  - build with RENDER_STATS defined as 0 and every STAT_ macro compiles to
+//    nothing
+// ==========================================================================
+#ifndef RENDERSTATS_H
+#define RENDERSTATS_H
+
+#include <iosfwd>
+#include <string>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+#ifndef RENDER_STATS
+#define RENDER_STATS 1
+#endif
+
+enum StatCounter
+{
+    STAT_PRIMARY_RAYS,
+    STAT_SHADOW_RAYS,
+    STAT_SPHERE_TESTS,          // one primitive at a time, without the BVH
+    STAT_PLANE_TESTS,
+    STAT_TRIANGLE_TESTS,
+    STAT_MESH_TRIANGLE_TESTS,
+    STAT_SPHERE_BLOCKS,         // BlockWidth primitives at a time, in BVH leaves
+    STAT_TRIANGLE_BLOCKS,
+    STAT_BVH_NODES,             // nodes visited, by a ray or by a packet
+    STAT_SHADED_POINTS,         // points lit by one light
+    STAT_COUNTER_COUNT
+};
+
+// time in each phase, summed over the threads that spent it
+enum StatPhase
+{
+    PHASE_PARSE,
+    PHASE_BUILD,
+    PHASE_TRACE,                // camera and shadow rays (--no-packets: camera only)
+    PHASE_SHADE,                // lighting, and shadow rays with --no-packets
+    PHASE_UPLOAD,
+    PHASE_SAVE,
+    STAT_PHASE_COUNT
+};
+
+// phases are timed in ticks, which are read a few times per packet and so
+// must be cheap: the time stamp counter on x86, nanoseconds elsewhere
+inline unsigned long long statTicks()
+{
+#if defined(_MSC_VER) || defined(__i386__) || defined(__x86_64__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct renderStats
+{
+    unsigned long long counts[STAT_COUNTER_COUNT];
+    unsigned long long ticks[STAT_PHASE_COUNT];
+};
+
+// each thread's block, made by newThreadStats() the first time it counts
+#if defined(_MSC_VER) && _MSC_VER < 1900
+extern __declspec(thread) renderStats *localStats;  // no thread_local in VS2013
+#else
+extern thread_local renderStats *localStats;
+#endif
+renderStats *newThreadStats();
+
+inline renderStats &threadStats()
+{
+    return localStats ? *localStats : *newThreadStats();
+}
+
+// what a pixel costs to render, for the --heatmap image
+enum CostMeasure
+{
+    NO_COST,
+    CYCLE_COST,                 // statTicks() spent tracing and shading it
+    TEST_COST                   // intersection tests and BVH nodes it took
+};
+
+const char *costMeasureName(CostMeasure measure);
+bool parseCostMeasure(const std::string &name, CostMeasure *measure);
+
+// a running total for the calling thread, in units of measure; what a pixel
+// cost is the difference before and after it. Tests are only counted when
+// RENDER_STATS is on.
+inline unsigned long long costCounter(CostMeasure measure)
+{
+    if (measure == CYCLE_COST)
+        return statTicks();
+    const unsigned long long *counts = threadStats().counts;
+    return counts[STAT_SPHERE_TESTS] + counts[STAT_PLANE_TESTS] + counts[STAT_TRIANGLE_TESTS] +
+        counts[STAT_MESH_TRIANGLE_TESTS] + counts[STAT_SPHERE_BLOCKS] +
+        counts[STAT_TRIANGLE_BLOCKS] + counts[STAT_BVH_NODES];
+}
+
+// the sum of every thread's block; call it only while nothing is counting,
+// e.g. between frames
+renderStats collectStats();
+
+// zeroes every thread's block, under the same rule
+void resetStats();
+
+// ticks of statTicks() per second, measured over the run so far
+double ticksPerSecond();
+
+// a summary a person can read for a frame that took frameSeconds, and the
+// same numbers as a JSON object
+void printStats(std::ostream &out, const renderStats &stats, double frameSeconds);
+void writeStatsJson(std::ostream &out, const renderStats &stats, double frameSeconds);
+
+// adds the ticks from construction to destruction to one phase
+class StatTimer
+{
+    StatPhase m_phase;
+    unsigned long long m_start;
+
+public:
+    explicit StatTimer(StatPhase phase) : m_phase(phase), m_start(statTicks()) {}
+    ~StatTimer() { threadStats().ticks[m_phase] += statTicks() - m_start; }
+};
+
+#if RENDER_STATS
+#define STAT_ADD(counter, n)    (threadStats().counts[counter] += (n))
+#define STAT_TIMER(phase)       StatTimer statTimer##phase(phase)
+#else
+#define STAT_ADD(counter, n)    ((void)0)
+#define STAT_TIMER(phase)       ((void)0)
+#endif
+
+// --------------------------------------------------------------------------
+#endif // RENDERSTATS_H
@@ -0,0 +1,47 @@
+// ==========================================================================
+// Scene Object Definitions
+//  - conversion of scene file records into their prepared forms
+// ==========================================================================
+
+#include "Scene.h"
+
+using namespace glm;
+
+// --------------------------------------------------------------------------
+
+preparedSphere prepareSphere(const sphere &s)
+{
+	preparedSphere p;
+	p.center = s.center;
+	p.radius = s.radius;
+	p.radiusSquared = s.radius * s.radius;
+	p.invRadius = 1.0f / s.radius;
+	p.color = s.color;
+	return p;
+}
+
+preparedPlane preparePlane(const plane &p)
+{
+	preparedPlane prepared;
+	prepared.normal = normalize(p.normal);
+	prepared.offset = dot(prepared.normal, p.position);
+	prepared.color = p.color;
+	return prepared;
+}
+
+preparedTriangle prepareTriangle(const triangle &t)
+{
+	preparedTriangle p;
+	p.P0 = t.P0;
+	p.P1 = t.P1;
+	p.P2 = t.P2;
+	p.normal = normalize(cross(t.P1 - t.P0, t.P2 - t.P0));
+	p.offset = dot(p.normal, t.P0);
+	p.edgeNormal[0] = cross(p.normal, t.P1 - t.P0);
+	p.edgeNormal[1] = cross(p.normal, t.P2 - t.P1);
+	p.edgeNormal[2] = cross(p.normal, t.P0 - t.P2);
+	p.color = t.color;
+	return p;
+}
+
+// --------------------------------------------------------------------------
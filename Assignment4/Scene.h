@@ -0,0 +1,120 @@
+// ==========================================================================
+// Scene Object Definitions
+//  - the primitive records read from scene files, and the rays traced
+//    against them
+// ==========================================================================
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+
+struct light
+{
+	glm::vec3 position;
+	float intensity;
+};
+
+struct sphere
+{
+	glm::vec3 center;
+	float radius;
+	glm::vec3 color;
+};
+
+struct plane
+{
+	glm::vec3 normal;
+	glm::vec3 position;
+	glm::vec3 color;
+};
+
+struct triangle
+{
+	glm::vec3 P0;
+	glm::vec3 P1;
+	glm::vec3 P2;
+	glm::vec3 color;
+};
+
+struct ray
+{
+	glm::vec3 origin;
+	glm::vec3 direction;
+};
+
+// --------------------------------------------------------------------------
+// Read-only forms of the records above, with everything that does not depend
+// on the ray worked out once at load time. These are what the intersection
+// routines and the acceleration structures consume.
+
+struct preparedSphere
+{
+	glm::vec3 center;
+	float radius;
+	float radiusSquared;
+	float invRadius;
+	glm::vec3 color;
+};
+
+struct preparedPlane
+{
+	glm::vec3 normal;		//unit length
+	float offset;			//dot(normal, position)
+	glm::vec3 color;
+};
+
+struct preparedTriangle
+{
+	glm::vec3 P0, P1, P2;
+	glm::vec3 normal;		//unit normal of the plane the triangle lies in
+	float offset;			//dot(normal, P0)
+
+	//cross(normal, edge) for the edges starting at P0, P1 and P2; a point x
+	//in the plane is inside edge i when dot(x - Pi, edgeNormal[i]) >= 0
+	glm::vec3 edgeNormal[3];
+	glm::vec3 color;
+};
+
+// --------------------------------------------------------------------------
+// Indexed triangle meshes. All the meshes of a scene share one vertex array
+// and one index array with three indices per triangle, and are intersected
+// straight from those; a mesh is a run of consecutive triangles in them
+// with one material.
+
+struct mesh
+{
+	int firstTriangle;		//first triangle, counted in index triples
+	int triangleCount;
+	glm::vec3 color;
+};
+
+preparedSphere prepareSphere(const sphere &s);
+preparedPlane preparePlane(const plane &p);
+preparedTriangle prepareTriangle(const triangle &t);
+
+// --------------------------------------------------------------------------
+// identifies one primitive of the scene: which vector it lives in, and where
+enum PrimitiveType
+{
+	SPHERE_PRIMITIVE,
+	PLANE_PRIMITIVE,
+	TRIANGLE_PRIMITIVE,
+	MESH_TRIANGLE_PRIMITIVE		//index counts triangles across all meshes
+};
+
+struct primitiveRef
+{
+	PrimitiveType type;
+	int index;
+};
+
+// the result of a ray query: which primitive was hit, and how far along the
+// ray; queries return false instead of filling one in when nothing is hit
+struct Hit
+{
+	float t;
+	primitiveRef primitive;
+};
+
+// --------------------------------------------------------------------------
+#endif // SCENE_H
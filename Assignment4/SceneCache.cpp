@@ -0,0 +1,117 @@
+// ==========================================================================
+// Scene Cache
+// ==========================================================================
+
+#include <iostream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "SceneCache.h"
+#include "SceneParser.h"
+
+using namespace std;
+
+// --------------------------------------------------------------------------
+
+void sceneData::Clear()
+{
+    lights.clear();
+    spheres.clear();
+    planes.clear();
+    triangles.clear();
+    meshVertices.clear();
+    meshIndices.clear();
+    meshes.clear();
+    Prepare();
+    bvh.Build(*this);
+}
+
+void sceneData::Prepare()
+{
+    preparedSpheres.resize(spheres.size());
+    for (int i = 0; i < spheres.size(); ++i)
+        preparedSpheres[i] = prepareSphere(spheres[i]);
+
+    preparedPlanes.resize(planes.size());
+    for (int i = 0; i < planes.size(); ++i)
+        preparedPlanes[i] = preparePlane(planes[i]);
+
+    preparedTriangles.resize(triangles.size());
+    for (int i = 0; i < triangles.size(); ++i)
+        preparedTriangles[i] = prepareTriangle(triangles[i]);
+}
+
+namespace
+{
+    // what MeshOf() returns for a triangle of a scene without meshes, which
+    // loaders never make; black shows it up without crashing
+    const mesh NoMesh = { 0, 0, glm::vec3(0, 0, 0) };
+}
+
+const mesh &sceneData::MeshOf(int triangle) const
+{
+    if (meshes.empty())
+        return NoMesh;
+
+    // meshes are sorted by firstTriangle; find the last one starting at or
+    // before triangle
+    int lower = 0, upper = int(meshes.size()) - 1;
+    while (lower < upper)
+    {
+        int middle = (lower + upper + 1) / 2;
+        if (meshes[middle].firstTriangle <= triangle)
+            lower = middle;
+        else
+            upper = middle - 1;
+    }
+    return meshes[lower];
+}
+
+// --------------------------------------------------------------------------
+
+shared_ptr<const sceneData> SceneCache::Get(const string &path, unsigned int *generation)
+{
+    // this runs on every window event, so a failure is only reported, and
+    // a broken file only parsed, once until the file changes
+    map<string, time_t>::iterator failed = m_failures.find(path);
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+    {
+        if (failed == m_failures.end() || failed->second != -1)
+            cout << "ERROR: Could not find scene file " << path << endl;
+        m_failures[path] = -1;
+        return shared_ptr<const sceneData>();
+    }
+    if (failed != m_failures.end())
+    {
+        if (failed->second == info.st_mtime)
+            return shared_ptr<const sceneData>();
+        m_failures.erase(failed);
+    }
+
+    map<string, Entry>::iterator found = m_entries.find(path);
+    if (found != m_entries.end() && found->second.modified == info.st_mtime)
+    {
+        if (generation)
+            *generation = found->second.generation;
+        return found->second.scene;
+    }
+
+    // first request, or the file was saved since it was cached
+    unique_ptr<sceneData> scene(new sceneData);
+    if (!loadAllObjects(path, scene.get()))
+    {
+        m_failures[path] = info.st_mtime;
+        return shared_ptr<const sceneData>();
+    }
+    scene->bvh.Build(*scene);
+
+    Entry &entry = m_entries[path];
+    entry.modified = info.st_mtime;
+    entry.generation = ++m_loads;
+    entry.scene = shared_ptr<const sceneData>(std::move(scene));
+    if (generation)
+        *generation = entry.generation;
+    return entry.scene;
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,97 @@
+// ==========================================================================
+// Scene Cache
+//  - loads scene files into memory once, together with everything the
+//    tracer derives from them, and keeps them resident
+//  - a cached scene is reused until its file changes on disk
+// ==========================================================================
+#ifndef SCENECACHE_H
+#define SCENECACHE_H
+
+#include <ctime>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Scene.h"
+#include "BVH.h"
+
+// --------------------------------------------------------------------------
+// One scene held in memory: the records read from its file, the prepared
+// forms the tracer reads, and the BVH over them. Binary scene files go
+// straight to the prepared forms, so only the lights and meshes are kept.
+
+struct sceneData
+{
+    std::vector<light> lights;
+    std::vector<sphere> spheres;
+    std::vector<plane> planes;
+    std::vector<triangle> triangles;
+
+    std::vector<preparedSphere> preparedSpheres;
+    std::vector<preparedPlane> preparedPlanes;
+    std::vector<preparedTriangle> preparedTriangles;
+
+    // indexed meshes, used as they are; see mesh in Scene.h
+    std::vector<glm::vec3> meshVertices;
+    std::vector<unsigned int> meshIndices;
+    std::vector<mesh> meshes;
+
+    BVH bvh;
+
+    // empties every vector, leaving an empty scene
+    void Clear();
+
+    // rebuilds the prepared vectors from the records; call after changing
+    // them, then rebuild the BVH if it is used
+    void Prepare();
+
+    // number of triangles in all meshes together
+    int MeshTriangleCount() const   { return int(meshIndices.size() / 3); }
+
+    // the mesh that the given mesh triangle belongs to; a black, empty one
+    // if the scene has no meshes
+    const mesh &MeshOf(int triangle) const;
+};
+
+// --------------------------------------------------------------------------
+// This class maps scene file paths to loaded scenes. A file is parsed and its
+// BVH built the first time it is asked for, and again only if its
+// modification time has changed since. A file that is missing or fails to
+// load is reported once and not tried again until that changes.
+
+class SceneCache
+{
+    struct Entry
+    {
+        std::time_t modified;
+        unsigned int generation;
+        std::shared_ptr<const sceneData> scene;
+    };
+
+    std::map<std::string, Entry> m_entries;
+    unsigned int m_loads;       // successful loads so far, of any path
+
+    // the modification time of each path's last failed load, or -1 if the
+    // file was missing
+    std::map<std::string, std::time_t> m_failures;
+
+    SceneCache(const SceneCache &);
+    SceneCache &operator=(const SceneCache &);
+
+public:
+    SceneCache() : m_loads(0) {}
+
+    // returns the scene loaded from path, or null if the file cannot be
+    // read. If generation is given it is set to a number that differs for
+    // every load, of any path, so a caller can tell a reloaded scene from
+    // the one it has even if the new one happens to get the old address.
+    // The cache lets go of a scene when its file is reloaded; callers that
+    // keep using it hold on to the pointer.
+    std::shared_ptr<const sceneData> Get(const std::string &path,
+                                         unsigned int *generation = 0);
+
+    int Size() const    { return int(m_entries.size()); }
+};
+
+// --------------------------------------------------------------------------
+#endif // SCENECACHE_H
@@ -0,0 +1,259 @@
+// ==========================================================================
+// Scene File Parser
+// ==========================================================================
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include "SceneParser.h"
+#include "MappedFile.h"
+#include "BinaryScene.h"
+#include "RenderStats.h"
+#include "TraceRecorder.h"
+#include "PerfCounters.h"
+
+// floating point std::from_chars needs a C++17 library that implements it
+// (VS2019, libstdc++ 11); older ones parse a NUL-terminated copy with strtof
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <charconv>
+#endif
+
+using namespace std;
+using namespace glm;
+
+// --------------------------------------------------------------------------
+
+namespace
+{
+    // more values than any object takes; extra ones are ignored
+    const int MaxValues = 16;
+
+    // reads three values starting at index, or returns fallback if the scene
+    // file left them out (e.g. scene2.txt gives no colours or light intensity)
+    vec3 readVec3(const float *values, int count, int index, vec3 fallback)
+    {
+        if (index + 2 >= count)
+            return fallback;
+        return vec3(values[index], values[index + 1], values[index + 2]);
+    }
+
+    bool isType(const char *word, size_t length, const char *type)
+    {
+        return length == strlen(type) && memcmp(word, type, length) == 0;
+    }
+
+    // adds one "type { values }" block from the scene file to the scene
+    void addObject(const char *type, size_t typeLength, const float *values,
+                   int count, sceneData *scene)
+    {
+        if (isType(type, typeLength, "light") && count >= 3)
+        {
+            light l;
+            l.position = readVec3(values, count, 0, vec3(0, 0, 0));
+            l.intensity = count > 3 ? values[3] : 1.0f;
+            scene->lights.push_back(l);
+        }
+        else if (isType(type, typeLength, "sphere") && count >= 4)
+        {
+            sphere s;
+            s.center = readVec3(values, count, 0, vec3(0, 0, 0));
+            s.radius = values[3];
+            s.color = readVec3(values, count, 4, vec3(1, 1, 1));
+            scene->spheres.push_back(s);
+        }
+        else if (isType(type, typeLength, "triangle") && count >= 9)
+        {
+            triangle t;
+            t.P0 = readVec3(values, count, 0, vec3(0, 0, 0));
+            t.P1 = readVec3(values, count, 3, vec3(0, 0, 0));
+            t.P2 = readVec3(values, count, 6, vec3(0, 0, 0));
+            t.color = readVec3(values, count, 9, vec3(1, 1, 1));
+            scene->triangles.push_back(t);
+        }
+        else if (isType(type, typeLength, "plane") && count >= 6)
+        {
+            plane p;
+            p.normal = readVec3(values, count, 0, vec3(0, 1, 0));
+            p.position = readVec3(values, count, 3, vec3(0, 0, 0));
+            p.color = readVec3(values, count, 6, vec3(1, 1, 1));
+            scene->planes.push_back(p);
+        }
+    }
+
+    // a word ends at whitespace, a brace or a comment
+    inline bool endsWord(char c)
+    {
+        return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\f' ||
+               c == '\v' || c == '{' || c == '}' || c == '#';
+    }
+}
+
+// --------------------------------------------------------------------------
+
+bool parseFloat(const char *first, const char *last, float *value)
+{
+    // from_chars does not take the leading plus that stof used to allow
+    if (first < last && *first == '+')
+        ++first;
+
+#ifdef __cpp_lib_to_chars
+    from_chars_result result = from_chars(first, last, *value);
+    return result.ec == errc() && result.ptr == last;
+#else
+    char buffer[64];
+    size_t length = last - first;
+    if (length == 0 || length >= sizeof(buffer))
+        return false;
+    memcpy(buffer, first, length);
+    buffer[length] = 0;
+
+    char *stop;
+    *value = strtof(buffer, &stop);
+    return stop == buffer + length;
+#endif
+}
+
+bool parseSceneText(const char *text, size_t length, const string &name,
+                    sceneData *scene)
+{
+    const char *p = text;
+    const char *end = text + length;
+    int line = 1;
+
+    // the object being read: its type word once seen, and its values so far
+    const char *type = 0;
+    size_t typeLength = 0;
+    float values[MaxValues];
+    int count = 0;
+
+    while (p < end)
+    {
+        char c = *p;
+        if (c == '\n')
+        {
+            ++line;
+            ++p;
+        }
+        else if (c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v' || c == '{')
+            ++p;
+        else if (c == '#')
+        {
+            // comments run to the end of the line
+            const char *newline = static_cast<const char *>(memchr(p, '\n', end - p));
+            p = newline ? newline : end;
+        }
+        else if (c == '}')
+        {
+            if (type)
+                addObject(type, typeLength, values, count, scene);
+            type = 0;
+            count = 0;
+            ++p;
+        }
+        else
+        {
+            const char *word = p;
+            while (p < end && !endsWord(*p))
+                ++p;
+
+            // the first word of an object names its type, the rest are values
+            float value;
+            if (!type)
+            {
+                type = word;
+                typeLength = p - word;
+            }
+            else if (parseFloat(word, p, &value))
+            {
+                if (count < MaxValues)
+                    values[count++] = value;
+            }
+            else
+            {
+                cout << "ERROR: " << name << ":" << line << ": expected a number but found \""
+                     << string(word, p) << "\"" << endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool loadAllObjects(const string &filename, sceneData *scene)
+{
+    STAT_TIMER(PHASE_PARSE);
+    TRACE_SCOPE("load scene");
+    PERF_SCOPE(PERF_LOAD);
+    MappedFile file;
+    if (!file.Open(filename))
+    {
+        cout << "ERROR: Could not open scene file " << filename << endl;
+        return false;
+    }
+
+    // binary scenes are read in place, straight into their prepared forms
+    if (isBinaryScene(file.Data(), file.Size()))
+        return readBinaryScene(file.Data(), file.Size(), filename, scene);
+
+    bool parsed = parseSceneText(file.Data(), file.Size(), filename, scene);
+    scene->Prepare();
+    return parsed;
+}
+
+// --------------------------------------------------------------------------
+
+bool loadAllObjectsIostream(const string &filename, sceneData *scene)
+{
+    ifstream file(filename);
+    if (!file)
+    {
+        cout << "ERROR: Could not open scene file " << filename << endl;
+        return false;
+    }
+
+    string line;
+    string type;
+    vector<float> values;
+    while (getline(file, line))
+    {
+        // drop comments and split braces off into words of their own
+        line = line.substr(0, line.find('#'));
+        string spaced;
+        for (int i = 0; i < line.size(); ++i)
+        {
+            if (line[i] == '{' || line[i] == '}')
+                spaced += string(" ") + line[i] + " ";
+            else
+                spaced += line[i];
+        }
+
+        istringstream words(spaced);
+        string word;
+        while (words >> word)
+        {
+            if (word == "{")
+                continue;
+            else if (word == "}")
+            {
+                int count = int(std::min(values.size(), size_t(MaxValues)));
+                addObject(type.c_str(), type.size(), values.empty() ? 0 : &values[0],
+                          count, scene);
+                type.clear();
+                values.clear();
+            }
+            else if (type.empty())
+                type = word;
+            else
+                values.push_back(stof(word));
+        }
+    }
+
+    scene->Prepare();
+    return true;
+}
+
+// --------------------------------------------------------------------------
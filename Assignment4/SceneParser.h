@@ -0,0 +1,34 @@
+// ==========================================================================
+// Scene File Parser
+//  - reads the "type { values }" scene text format straight out of a
+//    memory-mapped file, adding each object to the scene as its closing
+//    brace is reached, without building strings or token lists
+// ==========================================================================
+#ifndef SCENEPARSER_H
+#define SCENEPARSER_H
+
+#include <cstddef>
+#include <string>
+#include "SceneCache.h"
+
+// parses all of [first, last) as one number, in the "C" locale whatever the
+// current locale is; an optional leading sign is allowed
+bool parseFloat(const char *first, const char *last, float *value);
+
+// parses scene text in [text, text + length) and appends its objects to
+// scene; name is only used in error messages. Returns false, with the scene
+// holding everything before the error, if a value is not a number.
+bool parseSceneText(const char *text, size_t length, const std::string &name,
+                    sceneData *scene);
+
+// maps a scene file, either text or the binary format written by
+// writeBinaryScene(), reads it into scene and prepares the objects, but does
+// not build the BVH; returns false if the file could not be opened or read
+bool loadAllObjects(const std::string &filename, sceneData *scene);
+
+// the previous line-by-line iostream loader, kept as the baseline the
+// parse benchmark measures loadAllObjects() against
+bool loadAllObjectsIostream(const std::string &filename, sceneData *scene);
+
+// --------------------------------------------------------------------------
+#endif // SCENEPARSER_H
@@ -0,0 +1,239 @@
+// ==========================================================================
+// SIMD Lanes
+//  - thin wrappers over vector instructions (AVX-512, AVX2, SSE4.1 and SSE2,
+//    and plain floats for anything else), so a kernel can be written once
+//    with ordinary operators and run on a whole vector of lanes at a time
+//  - only included by the kernel translation units of KernelDispatch.h,
+//    each of which is compiled for one instruction set; a lane type exists
+//    in a unit when that unit is compiled for its instructions
+// ==========================================================================
+#ifndef SIMDLANES_H
+#define SIMDLANES_H
+
+#include <cmath>
+
+// A unit that switches instruction set with GCC's target pragma defines the
+// SIMD_LANES_ macros for it itself, as the pragma leaves __AVX2__ and the
+// like undefined.
+#if defined(__AVX512F__)
+#define SIMD_LANES_AVX512
+#endif
+#if defined(__AVX2__)
+#define SIMD_LANES_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_LANES_SSE2
+#endif
+// Visual C++ has the SSE4.1 intrinsics whatever the /arch flag
+#if defined(SIMD_LANES_SSE2) && (defined(__SSE4_1__) || defined(_MSC_VER))
+#define SIMD_LANES_SSE4
+#endif
+
+#if defined(SIMD_LANES_AVX512) || defined(SIMD_LANES_AVX2)
+#include <immintrin.h>
+#elif defined(SIMD_LANES_SSE4)
+#include <smmintrin.h>
+#elif defined(SIMD_LANES_SSE2)
+#include <emmintrin.h>
+#endif
+
+// --------------------------------------------------------------------------
+// Lane types. Each provides a Float and a Mask with the arithmetic and
+// comparison operators the kernels use, and
+//   Load(lo, hi)   Width floats from lo, or 8 from lo then 8 from hi when
+//                  Width is 16
+//   Set(x)         x in every lane
+//   Sqrt, Min, Max, Select(mask, a, b), Store, Bits (one bit per lane that
+//   is set), FromBits (the reverse), and StoreBytes (each lane, truncated
+//   to an integer in [0, 255], as one byte)
+//   Leave()        to be called on the way out of a kernel; clears the upper
+//                  halves of the AVX registers, as GCC does not always, and
+//                  SSE instructions after them would all run slowly
+// Min and Max return their second argument when the first is NaN.
+//
+// Everything here has internal linkage. The same inline function compiled
+// for AVX2 in one unit and for SSE2 in another would otherwise be merged by
+// the linker, and the AVX2 copy could end up running on a CPU without it.
+
+namespace
+{
+
+struct scalarLanes
+{
+    enum { Width = 1 };
+    typedef float Float;
+    typedef bool Mask;
+
+    static Float Load(const float *lo, const float *) { return *lo; }
+    static Float Set(float x) { return x; }
+#if defined(SIMD_LANES_SSE2)
+    // the instruction rather than std::sqrt, which is not internal
+    static Float Sqrt(Float x) { return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(x))); }
+#else
+    static Float Sqrt(Float x) { return std::sqrt(x); }
+#endif
+    static Float Min(Float a, Float b) { return a < b ? a : b; }
+    static Float Max(Float a, Float b) { return a > b ? a : b; }
+    static Float Select(Mask m, Float a, Float b) { return m ? a : b; }
+    static void Store(float *p, Float x) { *p = x; }
+    static unsigned Bits(Mask m) { return m ? 1u : 0u; }
+    static Mask FromBits(unsigned bits) { return (bits & 1) != 0; }
+    static void StoreBytes(unsigned char *p, Float x) { *p = (unsigned char)(x); }
+    static void Leave() {}
+};
+
+#if defined(SIMD_LANES_SSE2)
+struct sse2Float { __m128 v; };
+struct sse2Mask { __m128 v; };
+
+inline sse2Float operator+(sse2Float a, sse2Float b) { sse2Float r = { _mm_add_ps(a.v, b.v) }; return r; }
+inline sse2Float operator-(sse2Float a, sse2Float b) { sse2Float r = { _mm_sub_ps(a.v, b.v) }; return r; }
+inline sse2Float operator*(sse2Float a, sse2Float b) { sse2Float r = { _mm_mul_ps(a.v, b.v) }; return r; }
+inline sse2Float operator/(sse2Float a, sse2Float b) { sse2Float r = { _mm_div_ps(a.v, b.v) }; return r; }
+inline sse2Mask operator<(sse2Float a, sse2Float b)  { sse2Mask r = { _mm_cmplt_ps(a.v, b.v) }; return r; }
+inline sse2Mask operator<=(sse2Float a, sse2Float b) { sse2Mask r = { _mm_cmple_ps(a.v, b.v) }; return r; }
+inline sse2Mask operator>(sse2Float a, sse2Float b)  { sse2Mask r = { _mm_cmpgt_ps(a.v, b.v) }; return r; }
+inline sse2Mask operator>=(sse2Float a, sse2Float b) { sse2Mask r = { _mm_cmpge_ps(a.v, b.v) }; return r; }
+inline sse2Mask operator&(sse2Mask a, sse2Mask b)    { sse2Mask r = { _mm_and_ps(a.v, b.v) }; return r; }
+
+struct sse2Lanes
+{
+    enum { Width = 4 };
+    typedef sse2Float Float;
+    typedef sse2Mask Mask;
+
+    static Float Load(const float *lo, const float *) { Float r = { _mm_loadu_ps(lo) }; return r; }
+    static Float Set(float x) { Float r = { _mm_set1_ps(x) }; return r; }
+    static Float Sqrt(Float x) { Float r = { _mm_sqrt_ps(x.v) }; return r; }
+    static Float Min(Float a, Float b) { Float r = { _mm_min_ps(a.v, b.v) }; return r; }
+    static Float Max(Float a, Float b) { Float r = { _mm_max_ps(a.v, b.v) }; return r; }
+    static Float Select(Mask m, Float a, Float b)
+    {
+        Float r = { _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)) };
+        return r;
+    }
+    static void Store(float *p, Float x) { _mm_storeu_ps(p, x.v); }
+    static unsigned Bits(Mask m) { return unsigned(_mm_movemask_ps(m.v)); }
+    static Mask FromBits(unsigned bits)
+    {
+        __m128i lanes = _mm_setr_epi32(1, 2, 4, 8);
+        __m128i set = _mm_and_si128(_mm_set1_epi32(int(bits)), lanes);
+        Mask r = { _mm_castsi128_ps(_mm_cmpeq_epi32(set, lanes)) };
+        return r;
+    }
+    static void StoreBytes(unsigned char *p, Float x)
+    {
+        __m128i words = _mm_packs_epi32(_mm_cvttps_epi32(x.v), _mm_setzero_si128());
+        int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+        p[0] = (unsigned char)(bytes);
+        p[1] = (unsigned char)(bytes >> 8);
+        p[2] = (unsigned char)(bytes >> 16);
+        p[3] = (unsigned char)(bytes >> 24);
+    }
+    static void Leave() {}
+};
+#endif
+
+#if defined(SIMD_LANES_SSE4)
+// SSE2 with a single-instruction blend
+struct sse4Lanes : sse2Lanes
+{
+    static Float Select(Mask m, Float a, Float b) { Float r = { _mm_blendv_ps(b.v, a.v, m.v) }; return r; }
+};
+#endif
+
+#if defined(SIMD_LANES_AVX2)
+struct avx2Float { __m256 v; };
+struct avx2Mask { __m256 v; };
+
+inline avx2Float operator+(avx2Float a, avx2Float b) { avx2Float r = { _mm256_add_ps(a.v, b.v) }; return r; }
+inline avx2Float operator-(avx2Float a, avx2Float b) { avx2Float r = { _mm256_sub_ps(a.v, b.v) }; return r; }
+inline avx2Float operator*(avx2Float a, avx2Float b) { avx2Float r = { _mm256_mul_ps(a.v, b.v) }; return r; }
+inline avx2Float operator/(avx2Float a, avx2Float b) { avx2Float r = { _mm256_div_ps(a.v, b.v) }; return r; }
+inline avx2Mask operator<(avx2Float a, avx2Float b)  { avx2Mask r = { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; return r; }
+inline avx2Mask operator<=(avx2Float a, avx2Float b) { avx2Mask r = { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; return r; }
+inline avx2Mask operator>(avx2Float a, avx2Float b)  { avx2Mask r = { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; return r; }
+inline avx2Mask operator>=(avx2Float a, avx2Float b) { avx2Mask r = { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; return r; }
+inline avx2Mask operator&(avx2Mask a, avx2Mask b)    { avx2Mask r = { _mm256_and_ps(a.v, b.v) }; return r; }
+
+struct avx2Lanes
+{
+    enum { Width = 8 };
+    typedef avx2Float Float;
+    typedef avx2Mask Mask;
+
+    static Float Load(const float *lo, const float *) { Float r = { _mm256_loadu_ps(lo) }; return r; }
+    static Float Set(float x) { Float r = { _mm256_set1_ps(x) }; return r; }
+    static Float Sqrt(Float x) { Float r = { _mm256_sqrt_ps(x.v) }; return r; }
+    static Float Min(Float a, Float b) { Float r = { _mm256_min_ps(a.v, b.v) }; return r; }
+    static Float Max(Float a, Float b) { Float r = { _mm256_max_ps(a.v, b.v) }; return r; }
+    static Float Select(Mask m, Float a, Float b) { Float r = { _mm256_blendv_ps(b.v, a.v, m.v) }; return r; }
+    static void Store(float *p, Float x) { _mm256_storeu_ps(p, x.v); }
+    static unsigned Bits(Mask m) { return unsigned(_mm256_movemask_ps(m.v)); }
+    static Mask FromBits(unsigned bits)
+    {
+        __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        __m256i set = _mm256_and_si256(_mm256_set1_epi32(int(bits)), lanes);
+        Mask r = { _mm256_castsi256_ps(_mm256_cmpeq_epi32(set, lanes)) };
+        return r;
+    }
+    static void StoreBytes(unsigned char *p, Float x)
+    {
+        __m256i integers = _mm256_cvttps_epi32(x.v);
+        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(integers),
+                                        _mm256_extracti128_si256(integers, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(p), _mm_packus_epi16(words, words));
+    }
+    static void Leave() { _mm256_zeroupper(); }
+};
+#endif
+
+#if defined(SIMD_LANES_AVX512)
+struct avx512Float { __m512 v; };
+struct avx512Mask { __mmask16 m; };
+
+inline avx512Float operator+(avx512Float a, avx512Float b) { avx512Float r = { _mm512_add_ps(a.v, b.v) }; return r; }
+inline avx512Float operator-(avx512Float a, avx512Float b) { avx512Float r = { _mm512_sub_ps(a.v, b.v) }; return r; }
+inline avx512Float operator*(avx512Float a, avx512Float b) { avx512Float r = { _mm512_mul_ps(a.v, b.v) }; return r; }
+inline avx512Float operator/(avx512Float a, avx512Float b) { avx512Float r = { _mm512_div_ps(a.v, b.v) }; return r; }
+inline avx512Mask operator<(avx512Float a, avx512Float b)  { avx512Mask r = { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; return r; }
+inline avx512Mask operator<=(avx512Float a, avx512Float b) { avx512Mask r = { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ) }; return r; }
+inline avx512Mask operator>(avx512Float a, avx512Float b)  { avx512Mask r = { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; return r; }
+inline avx512Mask operator>=(avx512Float a, avx512Float b) { avx512Mask r = { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ) }; return r; }
+inline avx512Mask operator&(avx512Mask a, avx512Mask b)    { avx512Mask r = { __mmask16(a.m & b.m) }; return r; }
+
+// 16 lanes: the low half comes from one block and the high half from
+// the next
+struct avx512Lanes
+{
+    enum { Width = 16 };
+    typedef avx512Float Float;
+    typedef avx512Mask Mask;
+
+    static Float Load(const float *lo, const float *hi)
+    {
+        __m512d low = _mm512_castps_pd(_mm512_castps256_ps512(_mm256_loadu_ps(lo)));
+        Float r = { _mm512_castpd_ps(_mm512_insertf64x4(low, _mm256_castps_pd(_mm256_loadu_ps(hi)), 1)) };
+        return r;
+    }
+    static Float Set(float x) { Float r = { _mm512_set1_ps(x) }; return r; }
+    static Float Sqrt(Float x) { Float r = { _mm512_sqrt_ps(x.v) }; return r; }
+    static Float Min(Float a, Float b) { Float r = { _mm512_min_ps(a.v, b.v) }; return r; }
+    static Float Max(Float a, Float b) { Float r = { _mm512_max_ps(a.v, b.v) }; return r; }
+    static Float Select(Mask m, Float a, Float b) { Float r = { _mm512_mask_blend_ps(m.m, b.v, a.v) }; return r; }
+    static void Store(float *p, Float x) { _mm512_storeu_ps(p, x.v); }
+    static unsigned Bits(Mask m) { return unsigned(m.m); }
+    static Mask FromBits(unsigned bits) { Mask r = { __mmask16(bits) }; return r; }
+    static void StoreBytes(unsigned char *p, Float x)
+    {
+        __m512i integers = _mm512_max_epi32(_mm512_cvttps_epi32(x.v), _mm512_setzero_si512());
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm512_cvtusepi32_epi8(integers));
+    }
+    static void Leave() { _mm256_zeroupper(); }
+};
+#endif
+
+}
+
+// --------------------------------------------------------------------------
+#endif // SIMDLANES_H
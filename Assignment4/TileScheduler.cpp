@@ -0,0 +1,136 @@
+// ==========================================================================
+// Work-Stealing Tile Scheduler
+// ==========================================================================
+
+#include "TileScheduler.h"
+
+using namespace std;
+
+// --------------------------------------------------------------------------
+
+TileScheduler::TileScheduler(int threadCount)
+    : m_task(0), m_generation(0), m_busyWorkers(0), m_shutdown(false),
+      m_tilesCompleted(0)
+{
+    if (threadCount <= 0)
+        threadCount = max(1, int(thread::hardware_concurrency()));
+
+    for (int i = 0; i < threadCount; ++i)
+        m_queues.push_back(unique_ptr<WorkQueue>(new WorkQueue));
+
+    // worker 0 is whichever thread calls Run()
+    for (int i = 1; i < threadCount; ++i)
+        m_threads.push_back(thread(&TileScheduler::WorkerLoop, this, i));
+}
+
+TileScheduler::~TileScheduler()
+{
+    {
+        lock_guard<mutex> guard(m_jobLock);
+        m_shutdown = true;
+    }
+    m_jobStarted.notify_all();
+    for (int i = 0; i < m_threads.size(); ++i)
+        m_threads[i].join();
+}
+
+// --------------------------------------------------------------------------
+
+bool TileScheduler::NextTile(int worker, int *tile)
+{
+    // own queue first, front to back
+    {
+        WorkQueue &queue = *m_queues[worker];
+        lock_guard<mutex> guard(queue.lock);
+        if (!queue.tiles.empty())
+        {
+            *tile = queue.tiles.front();
+            queue.tiles.pop_front();
+            return true;
+        }
+    }
+
+    // then steal from the back of the others, starting with our neighbour
+    int count = int(m_queues.size());
+    for (int i = 1; i < count; ++i)
+    {
+        WorkQueue &victim = *m_queues[(worker + i) % count];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.tiles.empty())
+        {
+            *tile = victim.tiles.back();
+            victim.tiles.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void TileScheduler::RunTiles(int worker)
+{
+    int tile;
+    while (NextTile(worker, &tile))
+    {
+        (*m_task)(tile, worker);
+        m_tilesCompleted.fetch_add(1, memory_order_release);
+    }
+}
+
+void TileScheduler::WorkerLoop(int worker)
+{
+    int generation = 0;
+    for (;;)
+    {
+        {
+            unique_lock<mutex> guard(m_jobLock);
+            while (!m_shutdown && m_generation == generation)
+                m_jobStarted.wait(guard);
+            if (m_shutdown) return;
+            generation = m_generation;
+        }
+
+        RunTiles(worker);
+
+        {
+            lock_guard<mutex> guard(m_jobLock);
+            if (--m_busyWorkers == 0)
+                m_jobFinished.notify_all();
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+
+void TileScheduler::Run(int tileCount, const Task &task)
+{
+    // hand each worker a contiguous run of tiles, so neighbouring tiles
+    // (which tend to cost about the same) start out on the same thread
+    int count = int(m_queues.size());
+    for (int i = 0; i < count; ++i)
+    {
+        WorkQueue &queue = *m_queues[i];
+        lock_guard<mutex> guard(queue.lock);
+        int begin = int((long long)tileCount * i / count);
+        int end = int((long long)tileCount * (i + 1) / count);
+        for (int tile = begin; tile < end; ++tile)
+            queue.tiles.push_back(tile);
+    }
+    m_tilesCompleted.store(0);
+
+    {
+        lock_guard<mutex> guard(m_jobLock);
+        m_task = &task;
+        m_busyWorkers = int(m_threads.size());
+        ++m_generation;
+    }
+    m_jobStarted.notify_all();
+
+    RunTiles(0);
+
+    unique_lock<mutex> guard(m_jobLock);
+    while (m_busyWorkers > 0)
+        m_jobFinished.wait(guard);
+    m_task = 0;
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,74 @@
+// ==========================================================================
+// Work-Stealing Tile Scheduler
+//  - a persistent pool of worker threads that renders image tiles
+//  - each worker owns a queue of tiles and steals from the others once its
+//    own queue runs dry, so slow tiles do not leave threads idle
+// ==========================================================================
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------------------------
+// This class runs a task once for every tile index, spread across a fixed
+// set of threads. The thread calling Run() takes part as worker 0.
+
+class TileScheduler
+{
+public:
+    // called as task(tileIndex, workerIndex) for each tile
+    typedef std::function<void(int, int)> Task;
+
+private:
+    // tiles waiting for one worker; the owner pops from the front, thieves
+    // take from the back, which is farthest from where the owner is working
+    struct WorkQueue
+    {
+        std::mutex lock;
+        std::deque<int> tiles;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue> > m_queues;
+    std::vector<std::thread> m_threads;
+
+    // the job being run, and the generation counter that announces it
+    std::mutex m_jobLock;
+    std::condition_variable m_jobStarted, m_jobFinished;
+    const Task *m_task;
+    int m_generation;
+    int m_busyWorkers;
+    bool m_shutdown;
+
+    std::atomic<int> m_tilesCompleted;
+
+    bool NextTile(int worker, int *tile);
+    void RunTiles(int worker);
+    void WorkerLoop(int worker);
+
+    TileScheduler(const TileScheduler &);
+    TileScheduler &operator=(const TileScheduler &);
+
+public:
+    // threadCount <= 0 uses one thread per hardware core
+    explicit TileScheduler(int threadCount = 0);
+    ~TileScheduler();
+
+    int ThreadCount() const     { return int(m_queues.size()); }
+
+    // tiles finished so far in the current (or last) Run(); safe to poll
+    // from any thread while a job is in flight
+    int TilesCompleted() const  { return m_tilesCompleted.load(); }
+
+    // runs task for tiles [0, tileCount) and returns when all are done
+    void Run(int tileCount, const Task &task);
+};
+
+// --------------------------------------------------------------------------
+#endif // TILESCHEDULER_H
@@ -0,0 +1,134 @@
+// ==========================================================================
+// Trace Recorder
+// ==========================================================================
+
+#include "TraceRecorder.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+bool traceEnabled = false;
+
+// --------------------------------------------------------------------------
+
+namespace
+{
+    // events kept per thread: a 512x512 frame is 256 tiles, so this is a
+    // few hundred frames' worth for a single thread
+    const unsigned int RingSize = 1 << 16;
+
+    struct traceRing
+    {
+        int thread;
+        atomic<unsigned int> written;   // events ever recorded; only its thread adds
+        traceEvent events[RingSize];
+    };
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+    __declspec(thread) traceRing *localRing = 0;
+#else
+    thread_local traceRing *localRing = 0;
+#endif
+
+    // every ring ever made, kept after its thread ends like the stats blocks
+    mutex registryLock;
+    vector<traceRing *> registry;
+
+    // escapes a name for a JSON string; names are literals, so this is for
+    // safety rather than need
+    void writeName(ostream &out, const char *name)
+    {
+        out << '"';
+        for (; *name; ++name)
+        {
+            if (*name == '"' || *name == '\\') out << '\\';
+            out << *name;
+        }
+        out << '"';
+    }
+}
+
+// --------------------------------------------------------------------------
+
+void startTrace()
+{
+    traceEnabled = true;
+}
+
+void recordTrace(const traceEvent &event)
+{
+    traceRing *ring = localRing;
+    if (!ring)
+    {
+        ring = localRing = new traceRing;
+        ring->written.store(0, memory_order_relaxed);
+        lock_guard<mutex> guard(registryLock);
+        ring->thread = int(registry.size());
+        registry.push_back(ring);
+    }
+
+    // the ring is this thread's alone, so publishing the count is all the
+    // synchronisation there is
+    unsigned int count = ring->written.load(memory_order_relaxed);
+    ring->events[count % RingSize] = event;
+    ring->written.store(count + 1, memory_order_release);
+}
+
+bool writeTrace(const string &fileName)
+{
+    lock_guard<mutex> guard(registryLock);
+
+    // times are microseconds since the first event kept
+    unsigned long long origin = ~0ull;
+    for (size_t r = 0; r < registry.size(); ++r)
+    {
+        unsigned int count = registry[r]->written.load(memory_order_acquire);
+        for (unsigned int i = count > RingSize ? count - RingSize : 0; i < count; ++i)
+            origin = std::min(origin, registry[r]->events[i % RingSize].start);
+    }
+    double microseconds = 1.0e6 / ticksPerSecond();
+
+    ofstream out(fileName);
+    out << "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [" << endl;
+    for (size_t r = 0; r < registry.size(); ++r)
+    {
+        // threads are numbered in the order they first recorded, which makes
+        // the one that loaded the scene number 0
+        const traceRing &ring = *registry[r];
+        out << (r ? ",\n" : "") << "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+            << ring.thread << ", \"args\": { \"name\": \"thread " << ring.thread << "\" } }";
+
+        unsigned int count = ring.written.load(memory_order_acquire);
+        if (count > RingSize)
+            cout << "trace: thread " << ring.thread << " dropped its oldest "
+                 << count - RingSize << " events" << endl;
+        for (unsigned int i = count > RingSize ? count - RingSize : 0; i < count; ++i)
+        {
+            const traceEvent &event = ring.events[i % RingSize];
+            out << ",\n{ \"name\": ";
+            writeName(out, event.name);
+            out << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << ring.thread
+                << ", \"ts\": " << (event.start - origin) * microseconds
+                << ", \"dur\": " << (event.end - event.start) * microseconds;
+            if (event.arg >= 0)
+                out << ", \"args\": { \"index\": " << event.arg << " }";
+            out << " }";
+        }
+    }
+    out << "\n] }" << endl;
+
+    if (!out)
+    {
+        cout << "ERROR: Could not write trace to " << fileName << endl;
+        return false;
+    }
+    cout << "trace written to " << fileName << endl;
+    return true;
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,72 @@
+// ==========================================================================
+// Trace Recorder
+//  - records when each thread loaded, built, rendered a tile, uploaded or
+//    saved, and writes it as Chrome trace-event JSON for chrome://tracing
+//    or Perfetto, to show load imbalance and stalls between tiles
+//  - each thread appends to its own fixed-size ring, with no locks and no
+//    allocation; once a ring is full its oldest events are overwritten
+//  - while tracing is off a scope costs one test of a flag, and building
+//    with RENDER_TRACE defined as 0 removes the scopes altogether
+// ==========================================================================
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <string>
+#include "RenderStats.h"
+
+#ifndef RENDER_TRACE
+#define RENDER_TRACE 1
+#endif
+
+// set by startTrace(), before any thread records; read-only afterwards
+extern bool traceEnabled;
+
+// one span of work on one thread; name must be a string literal, and arg is
+// shown with it unless it is negative (the tile index, for tiles)
+struct traceEvent
+{
+    const char *name;
+    unsigned long long start, end;      // statTicks()
+    int arg;
+};
+
+// turns recording on; events before this are not kept
+void startTrace();
+
+// appends an event to the calling thread's ring
+void recordTrace(const traceEvent &event);
+
+// writes every thread's events to fileName; call it only while nothing is
+// recording, e.g. after the last frame. False, with a message, on failure.
+bool writeTrace(const std::string &fileName);
+
+// records the span from construction to destruction, if tracing is on
+class TraceScope
+{
+    traceEvent m_event;
+
+public:
+    explicit TraceScope(const char *name, int arg = -1)
+    {
+        m_event.name = name;
+        m_event.arg = arg;
+        if (traceEnabled) m_event.start = statTicks();
+    }
+    ~TraceScope()
+    {
+        if (!traceEnabled) return;
+        m_event.end = statTicks();
+        recordTrace(m_event);
+    }
+};
+
+#if RENDER_TRACE
+#define TRACE_SCOPE(name)           TraceScope traceScope(name)
+#define TRACE_SCOPE_ARG(name, arg)  TraceScope traceScope(name, arg)
+#else
+#define TRACE_SCOPE(name)           ((void)0)
+#define TRACE_SCOPE_ARG(name, arg)  ((void)0)
+#endif
+
+// --------------------------------------------------------------------------
+#endif // TRACERECORDER_H
@@ -17,69 +17,166 @@
 #include <algorithm>
 #include <vector>
 #include <sstream>
+#include <chrono>
+#include <random>
+#include <limits>
+#include <functional>
 
 // specify that we want the OpenGL core profile before including GLFW headers
 #include <glad/glad.h>
 #include "imageBuffer.h"
 #include <GLFW/glfw3.h>
 #include <glm\glm.hpp>
+#include "Scene.h"
+#include "BVH.h"
+#include "KernelDispatch.h"
+#include "PixelOrder.h"
+#include "PrimitiveBlocks.h"
+#include "RayPacket.h"
+#include "RenderStats.h"
+#include "TraceRecorder.h"
+#include "PerfCounters.h"
+#include "SceneCache.h"
+#include "SceneParser.h"
+#include "BinaryScene.h"
+#include "BenchmarkReport.h"
+#include "MappedFile.h"
+#include "MeshImport.h"
+#include "TileScheduler.h"
 
 using namespace glm;
 using namespace std;
 
-struct light
+const sceneData *activeScene = 0;	//the scene being traced; set before rendering
+bool useBVH = true;		//false tests every primitive, for comparison
+bool usePackets = true;	//false traces every ray on its own, for comparison
+int windowX = 512;
+int windowY = 512;
+float PI = 3.14159265;
+int degree = 60;
+float FoV = degree * PI/180; //in radians
+int scene = 1;
+float ambientIntensity = 0.2;	//Ia of the Phong model, added once per shaded point
+bool castShadows = true;		//false skips shadow rays, for comparison
+const float ShadowEpsilon = 1e-3f;	//keeps shadow rays off their own surface
+const int TileSize = 32;	//images are rendered in TileSize x TileSize blocks
+PixelOrder pixelOrder = HILBERT_ORDER;	//how tiles, packets and pixels are walked
+PixelLayout imageLayout = TILED_LAYOUT;	//how the rendered image is kept in memory
+PixelFormat imageFormat = RGB32F_FORMAT;	//and how each of its pixels is stored
+colorEncoding imageEncoding = { false, false, false };	//how it is shown and saved
+CostMeasure pixelCost = NO_COST;	//what the G-buffer's cost records, if anything
+
+//camera parameters shared by every tile of one frame
+struct camera
 {
-	vec3 position;
-	float intensity;
+	vec3 origin;
+	float l, r, t, b;	//image plane extents
+	float w;			//image plane distance along -z
+	int width, height;	//image size in pixels
 };
 
-struct sphere
+//per-pixel results of the closest-hit pass, kept for reuse after shading
+struct GBuffer
 {
-	vec3 center;
-	float radius;
-	vec3 color;
-};
+	int width, height;
+	vector<float> depth;			//hit distance t, 0 where nothing was hit
+	vector<vec3> normal;			//unit surface normal at the hit
+	vector<primitiveRef> primitive;	//index -1 where nothing was hit
+	vector<float> cost;				//what the pixel cost to trace and shade, in pixelCost units
 
-struct plane
-{
-	vec3 normal;
-	vec3 position;
-	vec3 color;
+	GBuffer() : width(0), height(0)
+	{}
+
+	void Resize(int w, int h)
+	{
+		width = w;
+		height = h;
+		depth.resize(w * h);
+		normal.resize(w * h);
+		primitive.resize(w * h);
+		cost.resize(w * h);
+	}
 };
 
-struct triangle
+//the cells of the tile grid, and of one whole tile's packets and pixels, in
+//the order they are traced; RenderScene() builds them for pixelOrder
+struct traversal
 {
-	vec3 P0;
-	vec3 P1;
-	vec3 P2;
-	vec3 color;
+	vector<int> tiles;
+	vector<int> packets;	//in units of PacketWidth pixels
+	vector<int> pixels;
 };
 
-struct ray
+//command line options; an output file selects headless (batch) rendering
+struct RenderOptions
 {
-	vec3 origin;
-	vec3 direction;
+	string sceneFile;
+	string outFile;
+	string gbufferPrefix;	//if set, also save the G-buffer as prefix_*.ppm
+	string convertFile;		//if set, save the scene in binary form here instead of rendering
+	string meshFile;		//.obj or .ply mesh added to the scene, fitted into view
+	int width;
+	int height;
+	int syntheticTriangles;	//if > 0, render random triangles instead of sceneFile
+	int threads;			//render threads, 0 for one per core
+	bool benchBVH;			//run the BVH primitive-count scaling benchmark
+	bool benchThreads;		//run the thread-count scaling benchmark
+	bool benchParse;		//run the scene file parsing throughput benchmark
+	bool benchBlocks;		//run the SIMD block intersection benchmark
+	bool benchSuite;		//run the micro- and frame benchmarks for comparing builds
+	string benchOut;		//where the suite writes its report, .json or .csv
+	bool stats;				//print what each frame counted and how long its phases took
+	string statsJson;		//if set, also write those statistics here as JSON
+	string traceFile;		//if set, record a timeline of the run and save it here
+	int isa;				//KernelIsa picked with --isa, or -1 for the best there is
+	bool unindexed;			//turn meshes into separate triangles, for comparison
+
+	RenderOptions() : sceneFile("scene1.txt"), width(512), height(512),
+		syntheticTriangles(0), threads(0), benchBVH(false), benchThreads(false),
+		benchParse(false), benchBlocks(false), benchSuite(false), stats(false), isa(-1), unindexed(false)
+	{}
 };
 
-vector<light> lights;
-vector<sphere> spheres;
-vector<plane> planes;
-vector<triangle> triangles;
-int windowX = 512;
-int windowY = 512;
-float PI = 3.14159265;
-int degree = 60;
-float FoV = degree * PI/180; //in radians
-int scene = 1;
-
 //function declarations
 
-void loadAllObjects(string filename);
 float max(float a, float b);
-vec3 Phong(light light, vec3 point, vec3 normal, vec3 color, ray r, bool draw);
-vec4 intersectSphere(ray r, sphere sphere, light light);
-vec4 intersectPlane(ray ray, plane plane, light light);
-vec4 intersectTriangle(ray ray, triangle tri, light light);
+bool intersectSphere(const ray &r, const preparedSphere &sphere, float tMin, float tMax, float *t);
+bool intersectPlane(const ray &ray, const preparedPlane &plane, float tMin, float tMax, float *t);
+bool intersectTriangle(const ray &ray, const preparedTriangle &tri, float tMin, float tMax, float *t);
+bool intersectMeshTriangle(const ray &r, int triangle, float tMin, float tMax, float *t);
+bool closestHit(const ray &r, float tMin, float tMax, Hit *hit);
+bool anyHit(const ray &r, float tMin, float tMax);
+packetMask closestHitPacket(const rayPacket &packet, packetMask active, Hit *hits);
+vec3 surfaceNormal(const vec3 &x, const primitiveRef &p);
+bool occluded(const vec3 &point, const light &light);
+packetMask occludedPacket(const rayPacket &packet, packetMask active, const Hit *hits,
+	const light &light);
+void prepareShading(shadingPacket *shading, int lane, const ray &r, const Hit &hit);
+vec3 shade(const ray &r, const Hit &hit);
+ray cameraRay(const camera &cam, int i, int j);
+void writeGBuffer(GBuffer *gbuffer, int i, int j, const ray &r, const Hit *hit, float cost);
+void renderTile(ImageBuffer &imageBuffer, GBuffer *gbuffer, const camera &cam,
+	const traversal &order, int x0, int y0, int x1, int y1);
+void renderPacket(vec3 *pixels, int stride, GBuffer *gbuffer, const camera &cam,
+	int x0, int y0, int x1, int y1);
+void RenderScene(ImageBuffer &imageBuffer, TileScheduler &scheduler, GBuffer *gbuffer = 0);
+bool saveGBuffer(const GBuffer &gbuffer, const string &prefix);
+bool saveHeatmap(const GBuffer &gbuffer, const string &imageFile);
+bool ParseArguments(int argc, char *argv[], RenderOptions *options);
+bool loadScene(const RenderOptions &options, sceneData *scene);
+void fitVertices(vector<vec3> &vertices, int first, vec3 center, float size);
+void expandMeshes(sceneData *scene);
+int RenderHeadless(const RenderOptions &options);
+int ConvertScene(const RenderOptions &options);
+void generateSyntheticScene(int triangleCount, unsigned int seed, sceneData *scene);
+int RunBVHBenchmark(TileScheduler &scheduler);
+int RunThreadBenchmark(int maxThreads);
+bool writeSceneFile(const string &filename, const sceneData &scene);
+int RunParseBenchmark(int triangleCount);
+int RunBlockBenchmark(int isa);
+double bestOf(int repeats, const function<void()> &work);
+int RunBenchmarkSuite(const RenderOptions &options);
+bool reportStats(const RenderOptions &options, double frameSeconds);
 
 // --------------------------------------------------------------------------
 // OpenGL utility and support function prototypes
@@ -240,195 +337,673 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 // ==========================================================================
 // PROGRAM ENTRY POINT
 
-//This takes a file and files vector arrays with objects
-bool anyIntersect(ray r);
+float max(float a, float b)
+{
+	if (a >= b)
+		return a;
+	else
+		return b;
+}
 
-void loadAllObjects(string filename)
+//The intersect functions below are purely geometric: they return true and
+//set *t only if the ray hits the primitive at a distance in (tMin, tMax), so
+//anything farther than the closest hit so far is rejected as early as possible
+
+bool intersectSphere(const ray &r, const preparedSphere &sphere, float tMin, float tMax, float *t)
+{
+	STAT_ADD(STAT_SPHERE_TESTS, 1);
+	//calculate quadratic variables, relative to the sphere center
+	vec3 oc = r.origin - sphere.center;
+	float a = dot(r.direction, r.direction);
+	float b = 2 * dot(r.direction, oc);
+	float c = dot(oc, oc) - sphere.radiusSquared;
+
+	float determ = b*b - 4 * a*c;		//calculates determinant
+
+	if (determ < 0)						//if determ < 0 then no intersection
+		return false;
+
+	//try the nearer root first, then the farther one (ray starts inside)
+	float root = sqrt(determ);
+	float t1 = (-b - root) / (2 * a);
+	float t2 = (-b + root) / (2 * a);
+
+	if (t1 > tMin && t1 < tMax){ *t = t1; return true; }
+	if (t2 > tMin && t2 < tMax){ *t = t2; return true; }
+	return false;
+}
+
+bool intersectPlane(const ray &ray, const preparedPlane &plane, float tMin, float tMax, float *t)
+{
+	STAT_ADD(STAT_PLANE_TESTS, 1);
+	float para = dot(plane.normal, ray.direction);
+	if (para == 0)
+		return false;
+
+	float tPlane = (plane.offset - dot(plane.normal, ray.origin)) / para;
+	if (tPlane <= tMin || tPlane >= tMax)
+		return false;
+
+	*t = tPlane;
+	return true;
+}
+
+bool intersectTriangle(const ray &ray, const preparedTriangle &tri, float tMin, float tMax, float *t)
 {
-	ifstream file(filename);
-	string line;
-	ifstream line2;
-	string data;
-	vector<string> words;
-	int i = 0;
+	STAT_ADD(STAT_TRIANGLE_TESTS, 1);
+	//intersect the plane the triangle lies in, and give up early if that is
+	//already outside the interval
+	float para = dot(tri.normal, ray.direction);
+	if (para == 0)
+		return false;
+
+	float tPlane = (tri.offset - dot(tri.normal, ray.origin)) / para;
+	if (tPlane <= tMin || tPlane >= tMax)
+		return false;
 
-	while (getline(file, line, ' '))
+	vec3 x = ray.origin + (tPlane*ray.direction);
+
+	//then check that x is on the inner side of all three edges
+	float a = dot(x - tri.P0, tri.edgeNormal[0]);
+	float b = dot(x - tri.P1, tri.edgeNormal[1]);
+	float c = dot(x - tri.P2, tri.edgeNormal[2]);
+
+	if (a >= -0.001 && b >= -0.001 && c >= -0.001)
 	{
-		line.erase(std::remove(line.begin(), line.end(), '\n'), line.end());
-		line.erase(std::remove(line.begin(), line.end(), '}'), line.end());
-		line.erase(std::remove(line.begin(), line.end(), '{'), line.end());
-		line.erase(std::remove(line.begin(), line.end(), '#'), line.end());
-		words.push_back(line);
+		*t = tPlane;
+		return true;
 	}
-	
-	while (i < words.size())	
+	return false;
+}
+
+//Tests triangle number triangle of the scene's meshes, reading its corners
+//through the index array (Moller-Trumbore; nothing is stored per triangle)
+bool intersectMeshTriangle(const ray &r, int triangle, float tMin, float tMax, float *t)
+{
+	STAT_ADD(STAT_MESH_TRIANGLE_TESTS, 1);
+	const unsigned int *index = &activeScene->meshIndices[3 * triangle];
+	const vec3 &P0 = activeScene->meshVertices[index[0]];
+	const vec3 &P1 = activeScene->meshVertices[index[1]];
+	const vec3 &P2 = activeScene->meshVertices[index[2]];
+
+	vec3 e1 = P1 - P0;
+	vec3 e2 = P2 - P0;
+	vec3 p = cross(r.direction, e2);
+	float det = dot(e1, p);
+	if (det == 0)
+		return false;
+	float invDet = 1.0f / det;
+
+	//barycentric coordinates, with a little slack so shared edges stay closed
+	vec3 s = r.origin - P0;
+	float u = dot(s, p) * invDet;
+	if (u < -1e-5f || u > 1 + 1e-5f)
+		return false;
+	vec3 q = cross(s, e1);
+	float v = dot(r.direction, q) * invDet;
+	if (v < -1e-5f || u + v > 1 + 1e-5f)
+		return false;
+
+	float tHit = dot(e2, q) * invDet;
+	if (tHit <= tMin || tHit >= tMax)
+		return false;
+	*t = tHit;
+	return true;
+}
+
+//Finds the nearest primitive hit in (tMin, tMax) without shading anything;
+//each test is bounded by the best hit so far
+bool closestHit(const ray &r, float tMin, float tMax, Hit *hit)
+{
+	bool doesIntersect = false; //start every ray as non-intersect
+	float t;
+
+	//check intersect with all planes
+	for (int i = 0; i < activeScene->preparedPlanes.size(); i++)
 	{
-		if (!words.at(i).find("light"))
+		if (intersectPlane(r, activeScene->preparedPlanes[i], tMin, tMax, &t))
 		{
-			light l;
-			l.position = vec3(stof(words.at(i + 3)), stof(words.at(i + 4)), stof(words.at(i + 5)));
-			l.intensity = stof(words.at(i + 7));
-			lights.push_back(l);
+			tMax = t;
+			hit->t = t;
+			hit->primitive.type = PLANE_PRIMITIVE;
+			hit->primitive.index = i;
+			doesIntersect = true;
 		}
+	}
 
-		if (!words.at(i).find("sphere"))
+	//spheres and triangles come from the BVH leaves, nearest boxes first and
+	//a whole block of primitives per test, so anything beyond the closest hit
+	//so far is skipped entirely
+	if (useBVH)
+	{
+		const BVH &bvh = activeScene->bvh;
+		auto visit = [&](const BVH::Leaf &leaf, float &tLimit) -> bool
 		{
-			sphere s;
-			s.center = vec3(stof(words.at(i + 3)), stof(words.at(i + 4)), stof(words.at(i + 5)));
-			s.radius = stof(words.at(i + 7));
-			s.color = vec3(stof(words.at(i + 9)), stof(words.at(i + 10)), stof(words.at(i + 11)));
-			spheres.push_back(s);
+			if (closestHitBlocks(bvh.TriangleBlocks() + leaf.firstTriangleBlock,
+				leaf.triangleBlockCount, r, tMin, &tLimit, &hit->primitive) |
+				closestHitBlocks(bvh.SphereBlocks() + leaf.firstSphereBlock,
+				leaf.sphereBlockCount, r, tMin, &tLimit, &hit->primitive))
+			{
+				hit->t = tLimit;
+				doesIntersect = true;
+			}
+			return false;
+		};
+		activeScene->bvh.Traverse(r, tMax, visit);
+	}
+	else
+	{
+		//check intersect with all spheres
+		for (int i = 0; i < activeScene->preparedSpheres.size(); i++)
+		{
+			if (intersectSphere(r, activeScene->preparedSpheres[i], tMin, tMax, &t))
+			{
+				tMax = t;
+				hit->t = t;
+				hit->primitive.type = SPHERE_PRIMITIVE;
+				hit->primitive.index = i;
+				doesIntersect = true;
+			}
 		}
 
-		if (!words.at(i).find("triangle"))
+		//check intersect with all triangles
+		for (int i = 0; i < activeScene->preparedTriangles.size(); i++)
 		{
-			triangle t;
-			t.P0 = vec3(stof(words.at(i + 3)), stof(words.at(i + 4)), stof(words.at(i + 5)));
-			t.P1 = vec3(stof(words.at(i + 7)), stof(words.at(i + 8)), stof(words.at(i + 9)));
-			t.P2 = vec3(stof(words.at(i + 11)), stof(words.at(i + 12)), stof(words.at(i + 13)));
-			t.color = vec3(stof(words.at(i + 15)), stof(words.at(i + 16)), stof(words.at(i + 17)));
-			triangles.push_back(t);
+			if (intersectTriangle(r, activeScene->preparedTriangles[i], tMin, tMax, &t))
+			{
+				tMax = t;
+				hit->t = t;
+				hit->primitive.type = TRIANGLE_PRIMITIVE;
+				hit->primitive.index = i;
+				doesIntersect = true;
+			}
 		}
 
-		if (!words.at(i).find("plane"))
+		//check intersect with all mesh triangles
+		for (int i = 0; i < activeScene->MeshTriangleCount(); i++)
 		{
-			plane p;
-			p.normal = vec3(stof(words.at(i + 3)), stof(words.at(i + 4)), stof(words.at(i + 5)));
-			p.position = vec3(stof(words.at(i + 7)), stof(words.at(i + 8)), stof(words.at(i + 9)));
-			p.color = vec3(stof(words.at(i + 11)), stof(words.at(i + 12)), stof(words.at(i + 13)));
-			planes.push_back(p);
+			if (intersectMeshTriangle(r, i, tMin, tMax, &t))
+			{
+				tMax = t;
+				hit->t = t;
+				hit->primitive.type = MESH_TRIANGLE_PRIMITIVE;
+				hit->primitive.index = i;
+				doesIntersect = true;
+			}
 		}
-		i++;
 	}
+
+	return doesIntersect;
 }
 
-float max(float a, float b)
+//Returns true as soon as any primitive is hit in (tMin, tMax)
+bool anyHit(const ray &r, float tMin, float tMax)
 {
-	if (a >= b)
-		return a;
-	else
-		return b;
+	float t;
+	for (int i = 0; i < activeScene->preparedPlanes.size(); i++)
+	{
+		if (intersectPlane(r, activeScene->preparedPlanes[i], tMin, tMax, &t))
+			return true;
+	}
+
+	if (useBVH)
+	{
+		const BVH &bvh = activeScene->bvh;
+		bool hit = false;
+		auto visit = [&](const BVH::Leaf &leaf, float &tLimit) -> bool
+		{
+			hit = anyHitBlocks(bvh.TriangleBlocks() + leaf.firstTriangleBlock,
+				leaf.triangleBlockCount, r, tMin, tLimit) ||
+				anyHitBlocks(bvh.SphereBlocks() + leaf.firstSphereBlock,
+				leaf.sphereBlockCount, r, tMin, tLimit);
+			return hit;
+		};
+		activeScene->bvh.Traverse(r, tMax, visit);
+		return hit;
+	}
+
+	for (int i = 0; i < activeScene->preparedSpheres.size(); i++)
+	{
+		if (intersectSphere(r, activeScene->preparedSpheres[i], tMin, tMax, &t))
+			return true;
+	}
+	for (int i = 0; i < activeScene->preparedTriangles.size(); i++)
+	{
+		if (intersectTriangle(r, activeScene->preparedTriangles[i], tMin, tMax, &t))
+			return true;
+	}
+	for (int i = 0; i < activeScene->MeshTriangleCount(); i++)
+	{
+		if (intersectMeshTriangle(r, i, tMin, tMax, &t))
+			return true;
+	}
+	return false;
 }
 
-vec3 Phong(light light, vec3 point, vec3 normal, vec3 color, ray r, bool draw)
+//closestHit() for the active rays of a packet, which walk the BVH together;
+//fills in hits[lane] and returns the rays that hit something
+packetMask closestHitPacket(const rayPacket &packet, packetMask active, Hit *hits)
 {
-	vec3 l = normalize(light.position - point);
-	vec3 v = normalize(r.origin - point);
-	vec3 n = normalize(normal);
+	float tMax[PacketSize];
+	packetMask hitRays = 0;
+	for (packetMask rays = active; rays; rays &= rays - 1)
+	{
+		int lane = firstLane(rays);
+		tMax[lane] = numeric_limits<float>::max();
+		float t;
+		for (int i = 0; i < activeScene->preparedPlanes.size(); i++)
+		{
+			if (intersectPlane(packet.rays[lane], activeScene->preparedPlanes[i], 0, tMax[lane], &t))
+			{
+				tMax[lane] = t;
+				hits[lane].primitive.type = PLANE_PRIMITIVE;
+				hits[lane].primitive.index = i;
+				hitRays |= packetMask(1) << lane;
+			}
+		}
+	}
 
-	vec3 h = normalize(v + l);
+	//each ray that reaches a leaf tests its blocks on its own
+	const BVH &bvh = activeScene->bvh;
+	auto visit = [&](const BVH::Leaf &leaf, packetMask rays, float *tLimit) -> packetMask
+	{
+		for (; rays; rays &= rays - 1)
+		{
+			int lane = firstLane(rays);
+			if (closestHitBlocks(bvh.TriangleBlocks() + leaf.firstTriangleBlock,
+				leaf.triangleBlockCount, packet.rays[lane], 0, &tLimit[lane], &hits[lane].primitive) |
+				closestHitBlocks(bvh.SphereBlocks() + leaf.firstSphereBlock,
+				leaf.sphereBlockCount, packet.rays[lane], 0, &tLimit[lane], &hits[lane].primitive))
+				hitRays |= packetMask(1) << lane;
+		}
+		return 0;
+	};
+	bvh.TraversePacket(packet, active, tMax, visit);
 
-	vec3 ka = color;
-	vec3 kd = ka;
-	vec3 ks = vec3(0.7,0.7,0.7);
-	float Ia = 0.2;
-	float I = light.intensity;
-	int exp = 16;
+	for (packetMask rays = hitRays; rays; rays &= rays - 1)
+		hits[firstLane(rays)].t = tMax[firstLane(rays)];
+	return hitRays;
+}
 
-	vec3 ambient = ka * Ia;
-	vec3 diffuse = kd * I * max(0, dot(n, l));
-	vec3 specular = ks * I * pow(max(0, dot(n, h)), exp);
-	vec3 L = ambient + diffuse + specular;
+//Returns the unit surface normal of primitive p at the point x on it
+vec3 surfaceNormal(const vec3 &x, const primitiveRef &p)
+{
+	if (p.type == SPHERE_PRIMITIVE)
+	{
+		const preparedSphere &s = activeScene->preparedSpheres.at(p.index);
+		return (x - s.center) * s.invRadius;
+	}
+	if (p.type == PLANE_PRIMITIVE)
+		return activeScene->preparedPlanes.at(p.index).normal;
+	if (p.type == MESH_TRIANGLE_PRIMITIVE)
+	{
+		const unsigned int *index = &activeScene->meshIndices.at(3 * p.index);
+		const vec3 &P0 = activeScene->meshVertices[index[0]];
+		return normalize(cross(activeScene->meshVertices[index[1]] - P0,
+			activeScene->meshVertices[index[2]] - P0));
+	}
+	return activeScene->preparedTriangles.at(p.index).normal;
+}
 
-	if (draw == false)
-		return ambient + diffuse;
-	else
-		return L;
+//Shadow ray query: true if anything blocks the segment from point to the
+//light. Only hits strictly between the two ends count, the first one found
+//ends the search, and nothing is shaded along the way.
+bool occluded(const vec3 &point, const light &light)
+{
+	vec3 toLight = light.position - point;
+	float distance = length(toLight);
+
+	ray shadowRay;
+	shadowRay.origin = point;
+	shadowRay.direction = toLight / distance;
+	STAT_ADD(STAT_SHADOW_RAYS, 1);
+	PERF_SCOPE(PERF_SHADOW);
+	return anyHit(shadowRay, ShadowEpsilon, distance - ShadowEpsilon);
 }
 
-vec4 intersectSphere(ray r, sphere sphere, light light)
+//occluded() for the hit points of the active rays of a packet: their shadow
+//rays all end at the same light, so they are traced as a packet too, and
+//each one stops at its first hit. Returns the rays whose light is blocked.
+packetMask occludedPacket(const rayPacket &packet, packetMask active, const Hit *hits,
+	const light &light)
 {
-	//calculate quadratic variables
-	float a = dot(r.direction, r.direction);
-	float b = (2 * r.direction.x * (r.origin.x - sphere.center.x)) +
-		(2 * r.direction.y * (r.origin.y - sphere.center.y)) +
-		(2 * r.direction.z * (r.origin.z - sphere.center.z));
-	float c = dot(sphere.center, sphere.center) + dot(r.origin, r.origin) + (-2 * dot(sphere.center, r.origin)) - pow(sphere.radius, 2);
+	rayPacket shadowPacket;
+	float tMax[PacketSize];
+	packetMask blocked = 0;
+	STAT_ADD(STAT_SHADOW_RAYS, laneCount(active));
+	PERF_SCOPE(PERF_SHADOW);
+	for (packetMask rays = active; rays; rays &= rays - 1)
+	{
+		int lane = firstLane(rays);
+		const ray &r = packet.rays[lane];
+		vec3 point = r.origin + (hits[lane].t*r.direction);
+		vec3 toLight = light.position - point;
+		float distance = length(toLight);
+
+		ray shadowRay;
+		shadowRay.origin = point;
+		shadowRay.direction = toLight / distance;
+		setRay(&shadowPacket, lane, shadowRay);
+		tMax[lane] = distance - ShadowEpsilon;
 
-	float determ = pow(b, 2) - 4 * a*c;	//calculates determinant
+		float t;
+		for (int i = 0; i < activeScene->preparedPlanes.size(); i++)
+		{
+			if (intersectPlane(shadowRay, activeScene->preparedPlanes[i], ShadowEpsilon, tMax[lane], &t))
+			{
+				blocked |= packetMask(1) << lane;
+				break;
+			}
+		}
+	}
 
-	if (determ < 0)						//if determ < 0 then no intersection
-		return vec4(NULL, NULL, NULL, NULL);
-	else
+	const BVH &bvh = activeScene->bvh;
+	auto visit = [&](const BVH::Leaf &leaf, packetMask rays, float *tLimit) -> packetMask
 	{
-		float t1 = (-b + determ) / (2 * a);
-		float t2 = (-b - determ) / (2 * a);
-		float t;
+		packetMask finished = 0;
+		for (; rays; rays &= rays - 1)
+		{
+			int lane = firstLane(rays);
+			const ray &shadowRay = shadowPacket.rays[lane];
+			if (anyHitBlocks(bvh.TriangleBlocks() + leaf.firstTriangleBlock,
+				leaf.triangleBlockCount, shadowRay, ShadowEpsilon, tLimit[lane]) ||
+				anyHitBlocks(bvh.SphereBlocks() + leaf.firstSphereBlock,
+				leaf.sphereBlockCount, shadowRay, ShadowEpsilon, tLimit[lane]))
+				finished |= packetMask(1) << lane;
+		}
+		blocked |= finished;
+		return finished;
+	};
+	bvh.TraversePacket(shadowPacket, active & ~blocked, tMax, visit);
+	return blocked;
+}
 
-		if (t1 <= t2){ t = t1; }
-		else{ t = t2; }
+//Stores the point where ray r made the given hit as lane of the shading
+//packet, lit so far by ambient light only; only spheres get a specular
+//highlight
+void prepareShading(shadingPacket *shading, int lane, const ray &r, const Hit &hit)
+{
+	const primitiveRef &p = hit.primitive;
+	vec3 x = r.origin + (hit.t*r.direction);
+	vec3 n = surfaceNormal(x, p);
 
-		vec3 x = r.origin + (t*r.direction);
-		vec3 n = x - sphere.center;
-		vec3 color;
+	vec3 base;
+	bool draw = false;
+	if (p.type == SPHERE_PRIMITIVE)
+	{
+		base = activeScene->preparedSpheres.at(p.index).color;
+		draw = true;
+	}
+	else if (p.type == PLANE_PRIMITIVE)
+		base = activeScene->preparedPlanes.at(p.index).color;
+	else if (p.type == MESH_TRIANGLE_PRIMITIVE)
+		base = activeScene->MeshOf(p.index).color;
+	else
+		base = activeScene->preparedTriangles.at(p.index).color;
 
-		ray newRay;
-		newRay.origin = x;
-		newRay.direction = light.position - x;
+	setShading(shading, lane, x, n, r.origin, base, draw, ambientIntensity);
+}
 
-		color = Phong(light, x, n, sphere.color, r, true);
+//Shades the point where ray r made the given hit; this runs once per pixel,
+//for the closest hit only. Ambient light is added once, and each light that
+//is not blocked adds its diffuse (and for spheres, specular) term through
+//the Phong kernel, the same one renderPacket() uses for a whole packet.
+vec3 shade(const ray &r, const Hit &hit)
+{
+	shadingPacket shading;
+	prepareShading(&shading, 0, r, hit);
 
-		return vec4(color, t);
+	vec3 x = r.origin + (hit.t*r.direction);
+	for (int i = 0; i < activeScene->lights.size(); i++)
+	{
+		if (castShadows && occluded(x, activeScene->lights[i]))
+			continue;
+		STAT_ADD(STAT_SHADED_POINTS, 1);
+		activeKernels.phong(&shading, 1, activeScene->lights[i], 1);
 	}
-
+	return shadedColor(shading, 0);
 }
 
-vec4 intersectPlane(ray ray, plane plane, light light)
+//The camera ray through the centre of pixel (i, j)
+ray cameraRay(const camera &cam, int i, int j)
 {
-	float para = dot(plane.normal, ray.direction);
-	if (para != 0)
-	{
-		vec3 ppco = plane.position - ray.origin; //planePosition -cameraOrigin
-		float t = dot(ppco, plane.normal) / para;
+	vec3 cameraOrigin = cam.origin;
+	float l = cam.l, r = cam.r, t = cam.t, b = cam.b;
+	int width = cam.width, height = cam.height;
+
+	ray newRay; //init ray to be shot out of camera
 
-		if (t < 0)
-			return vec4(NULL, NULL, NULL, NULL);
+	//Calculates camera ray direction vector
+	float u = l + ((r - l) * (i + 0.5)) / (width);
+	float v = b + ((t - b) * (j + 0.5)) / (height);
+	float w = cam.w;
 
-		vec3 x = ray.origin + (t*ray.direction);
-		vec3 color = Phong(light, x, plane.normal, plane.color, ray, false);
+	//Ray data assignment
+	newRay.origin = cameraOrigin;
+	newRay.direction = normalize(vec3(u, v, w) - cameraOrigin);
+	return newRay;
+}
 
-		return vec4(color, t);
+//Stores the depth, normal and primitive of pixel (i, j), or clears them if
+//hit is null because its ray missed everything, and what the pixel cost
+void writeGBuffer(GBuffer *gbuffer, int i, int j, const ray &r, const Hit *hit, float cost)
+{
+	int index = j * gbuffer->width + i;
+	gbuffer->cost[index] = cost;
+	if (hit)
+	{
+		gbuffer->depth[index] = hit->t;
+		gbuffer->normal[index] = surfaceNormal(r.origin + hit->t * r.direction, hit->primitive);
+		gbuffer->primitive[index] = hit->primitive;
 	}
 	else
 	{
-		return vec4(NULL, NULL, NULL, NULL);
+		gbuffer->depth[index] = 0;
+		gbuffer->normal[index] = vec3(0, 0, 0);
+		gbuffer->primitive[index].index = -1;
 	}
 }
 
-vec4 intersectTriangle(ray ray, triangle tri, light light)
+//Traces one camera ray per pixel of the tile [x0, x1) x [y0, y1); all the
+//state it touches is local, so any number of tiles can render at once. The
+//closest hit is found first and then shaded exactly once, and its depth,
+//normal and primitive go to the G-buffer if one is given. With the BVH the
+//tile is traced as packets of PacketWidth x PacketWidth rays. Packets and
+//pixels are visited in the given order, skipping those past the image edge.
+//The tile is shaded into a copy of itself, so pixels nothing hit keep what
+//the image had there, and goes back to the image with a single WriteTile().
+void renderTile(ImageBuffer &imageBuffer, GBuffer *gbuffer, const camera &cam,
+	const traversal &order, int x0, int y0, int x1, int y1)
 {
-	//compute normal vector of plane which triangle resides
-	vec3 P1P0 = tri.P1 - tri.P0;
-	vec3 P2P0 = tri.P2 - tri.P0;
-	vec3 P2P1 = tri.P2 - tri.P1;
-	vec3 P0P2 = tri.P0 - tri.P2;
-	vec3 normal = normalize(cross(P1P0, P2P0));
+	vec3 pixels[TileSize * TileSize];
+	int stride = x1 - x0;
+	imageBuffer.ReadTile(x0, y0, x1 - x0, y1 - y0, pixels);
 
-	plane p;
-	p.normal = normal;
-	p.position = tri.P0;
+	if (useBVH && usePackets)
+	{
+		const int packetsAcross = TileSize / PacketWidth;
+		for (int k = 0; k < order.packets.size(); k++)
+		{
+			int px = x0 + order.packets[k] % packetsAcross * PacketWidth;
+			int py = y0 + order.packets[k] / packetsAcross * PacketWidth;
+			if (px < x1 && py < y1)
+				renderPacket(&pixels[(py - y0) * stride + (px - x0)], stride, gbuffer, cam, px, py,
+					std::min(px + PacketWidth, x1), std::min(py + PacketWidth, y1));
+		}
+	}
+	else
+	{
+		for (int k = 0; k < order.pixels.size(); k++)
+		{
+			int i = x0 + order.pixels[k] % TileSize;
+			int j = y0 + order.pixels[k] / TileSize;
+			if (i >= x1 || j >= y1)
+				continue;
+
+			ray newRay = cameraRay(cam, i, j);
+			STAT_ADD(STAT_PRIMARY_RAYS, 1);
+			unsigned long long costStart = pixelCost ? costCounter(pixelCost) : 0;
 
-	vec4 plane = intersectPlane(ray, p, light);
+			Hit hit;
+			bool doesIntersect;
+			{
+				STAT_TIMER(PHASE_TRACE);
+				PERF_SCOPE(PERF_PRIMARY);
+				doesIntersect = closestHit(newRay, 0, numeric_limits<float>::max(), &hit);
+			}
 
-	vec3 x = ray.origin + (plane.w*ray.direction); //plane.w is t
+			if (doesIntersect) //only if there was an intersect this ray, draw pixel
+			{
+				STAT_TIMER(PHASE_SHADE);
+				PERF_SCOPE(PERF_SHADE);
+				vec3 color = shade(newRay, hit);
+				pixels[(j - y0) * stride + (i - x0)] = color;
+			}
 
-	float a = dot(cross(P1P0, (x - tri.P0)), normal);
-	float b = dot(cross(P2P1, (x - tri.P1)), normal);
-	float c = dot(cross(P0P2, (x - tri.P2)), normal);
+			if (gbuffer)
+				writeGBuffer(gbuffer, i, j, newRay, doesIntersect ? &hit : 0,
+					pixelCost ? float(costCounter(pixelCost) - costStart) : 0.0f);
+		}
+	}
+	imageBuffer.WriteTile(x0, y0, x1 - x0, y1 - y0, pixels);
+}
 
-		if (a >= -0.001 && b >= -0.001 && c >= -0.001)
+//Traces the pixels [x0, x1) x [y0, y1), at most PacketWidth on a side, as
+//one packet: the camera rays walk the BVH together, and then so do the
+//shadow rays from their hits to each light, and the hits are shaded a light
+//at a time. Pixels come out the same as from tracing each ray on its own,
+//and go to pixels, which holds stride colours per row from (x0, y0) on.
+void renderPacket(vec3 *pixels, int stride, GBuffer *gbuffer, const camera &cam,
+	int x0, int y0, int x1, int y1)
+{
+	rayPacket packet;
+	packetMask active = 0;
+	for (int j = y0; j < y1; j++)
+	{
+		for (int i = x0; i < x1; i++)
 		{
-			vec3 color = Phong(light, x, normal, tri.color, ray, false);
-			return vec4(color, plane.w);
+			int lane = (j - y0) * PacketWidth + (i - x0);
+			setRay(&packet, lane, cameraRay(cam, i, j));
+			active |= packetMask(1) << lane;
 		}
-		else
+	}
+
+	STAT_ADD(STAT_PRIMARY_RAYS, laneCount(active));
+	unsigned long long costStart = pixelCost ? costCounter(pixelCost) : 0;
+
+	Hit hits[PacketSize];
+	packetMask hitRays;
+	{
+		STAT_TIMER(PHASE_TRACE);
+		PERF_SCOPE(PERF_PRIMARY);
+		hitRays = closestHitPacket(packet, active, hits);
+	}
+
+	//lanes that missed are zeros, which the kernel reads but never lights
+	shadingPacket shading = {};
+	{
+		STAT_TIMER(PHASE_SHADE);
+		PERF_SCOPE(PERF_SHADE);
+		for (packetMask rays = hitRays; rays; rays &= rays - 1)
 		{
-			return vec4(NULL, NULL, NULL, NULL);
+			int lane = firstLane(rays);
+			prepareShading(&shading, lane, packet.rays[lane], hits[lane]);
 		}
+	}
+	for (int k = 0; hitRays && k < activeScene->lights.size(); k++)
+	{
+		const light &light = activeScene->lights[k];
+		packetMask lit = hitRays;
+		if (castShadows)
+		{
+			STAT_TIMER(PHASE_TRACE);
+			lit &= ~occludedPacket(packet, hitRays, hits, light);
+		}
+		STAT_TIMER(PHASE_SHADE);
+		PERF_SCOPE(PERF_SHADE);
+		STAT_ADD(STAT_SHADED_POINTS, laneCount(lit));
+		activeKernels.phong(&shading, PacketSize, light, lit);
+	}
+
+	//the rays were traced together, so they share the packet's cost
+	float cost = pixelCost ? float(costCounter(pixelCost) - costStart) / laneCount(active) : 0.0f;
+	for (int j = y0; j < y1; j++)
+	{
+		for (int i = x0; i < x1; i++)
+		{
+			int lane = (j - y0) * PacketWidth + (i - x0);
+			bool doesIntersect = (hitRays >> lane & 1) != 0;
+			if (doesIntersect)
+				pixels[(j - y0) * stride + (i - x0)] = shadedColor(shading, lane);
+
+			if (gbuffer)
+				writeGBuffer(gbuffer, i, j, packet.rays[lane], doesIntersect ? &hits[lane] : 0, cost);
+		}
+	}
+}
+
+//Splits the image into tiles and traces them on all of the scheduler's
+//threads, filling in the G-buffer too if one is given. The scheduler hands
+//each thread a run of consecutive tiles, and in pixelOrder those are a
+//compact patch of the image rather than a strip of it.
+void RenderScene(ImageBuffer &imageBuffer, TileScheduler &scheduler, GBuffer *gbuffer)
+{
+	camera cam;
+	cam.width = imageBuffer.Width();
+	cam.height = imageBuffer.Height();
+	cam.origin = vec3(0, 0, 0);					//place camera origin
+	cam.t = 1;
+	cam.b = -cam.t;
+	cam.r = cam.t * cam.width / cam.height;		//keep pixels square for any image size
+	cam.l = -cam.r;
+	cam.w = -(cam.t / tan(FoV/2));				//dynamic Field of View
+
+	int tilesX = (cam.width + TileSize - 1) / TileSize;
+	int tilesY = (cam.height + TileSize - 1) / TileSize;
+	if (gbuffer)
+		gbuffer->Resize(cam.width, cam.height);
+
+	traversal order;
+	traversalOrder(pixelOrder, tilesX, tilesY, &order.tiles);
+	traversalOrder(pixelOrder, TileSize / PacketWidth, TileSize / PacketWidth, &order.packets);
+	traversalOrder(pixelOrder, TileSize, TileSize, &order.pixels);
+
+	TRACE_SCOPE("RenderScene");
+	scheduler.Run(tilesX * tilesY, [&](int tile, int worker)
+	{
+		TRACE_SCOPE_ARG("tile", order.tiles[tile]);
+		int x0 = (order.tiles[tile] % tilesX) * TileSize;
+		int y0 = (order.tiles[tile] / tilesX) * TileSize;
+		renderTile(imageBuffer, gbuffer, cam, order, x0, y0,
+			std::min(x0 + TileSize, cam.width), std::min(y0 + TileSize, cam.height));
+	});
 }
 
 int main(int argc, char *argv[])
 {   
+	RenderOptions options;
+	if (!ParseArguments(argc, argv, &options))
+		return -1;
+
+	//render straight to a file without creating a window or OpenGL context
+	if (options.benchThreads)
+		return RunThreadBenchmark(options.threads);
+	if (options.benchParse)
+		return RunParseBenchmark(options.syntheticTriangles > 0 ? options.syntheticTriangles : 1000000);
+	if (options.benchBlocks)
+		return RunBlockBenchmark(options.isa);
+	if (options.benchSuite)
+		return RunBenchmarkSuite(options);
+	if (options.benchBVH)
+	{
+		TileScheduler scheduler(options.threads);
+		return RunBVHBenchmark(scheduler);
+	}
+	if (!options.convertFile.empty())
+		return ConvertScene(options);
+	if (!options.outFile.empty())
+		return RenderHeadless(options);
+
     // initialize the GLFW windowing system
     if (!glfwInit()) {
         cout << "ERROR: GLFW failed to initilize, TERMINATING" << endl;
@@ -458,85 +1033,44 @@ int main(int argc, char *argv[])
 
     QueryGLVersion();
 
-	ImageBuffer imageBuffer;
+	ImageBuffer imageBuffer(imageLayout, imageFormat);
+	imageBuffer.SetEncoding(imageEncoding);
 	imageBuffer.Initialize();
+	TileScheduler scheduler(options.threads);
+
+	//Load all three scenes up front, so the 1/2/3 keys never wait on the disk
+	SceneCache sceneCache;
+	const char *sceneFiles[] = { "scene1.txt", "scene2.txt", "scene3.txt" };
+	for (int i = 0; i < 3; i++)
+		sceneCache.Get(sceneFiles[i]);
+
+	//the scene on screen, held here so that it outlives a reload of its file
+	//until activeScene has moved on to the new one
+	shared_ptr<const sceneData> shownScene;
+	unsigned int shownGeneration = 0;
 
     // run an event-triggered main loop
     while (!glfwWindowShouldClose(window))
     {
-		//Load objects from file
-		if (scene == 1)
-			loadAllObjects("scene1.txt");
-		if (scene == 2)
-			loadAllObjects("scene2.txt");
-		if (scene == 3)
-			loadAllObjects("scene3.txt");
-		cout << triangles.at(0).color.x << endl;
-		vec3 cameraOrigin(0, 0, 0);			//place camera origin
-
-		int l, r, t, b;						//init and set 
-		r = t = 1;
-		l = b = -r;
-
-        // call function to draw our scene
-		for (int i = 0; i < imageBuffer.Width(); i++)
-		{
-			for (int j = 0; j < imageBuffer.Height(); j++) 
-			{
-				ray newRay; //init ray to be shot out of camera
-				vec4 intersect; //init data vector for all intersects
-				vec4 closestInteresectAndColor(1.0, 1.0, 1.0, numeric_limits<float>::max()); //return color if there exists an intersection
-				bool doesIntersect = false; //start every ray as non-intersect
-
-				//Calculates camera ray direction vector
-				float u = l + ((r - l) * (i + 0.5)) / (windowX);
-				float v = b + ((t - b) * (j + 0.5)) / (windowY);
-				float w = -(r / tan(FoV/2)); //dynamic Field of View
-				
-				//Ray data assignment
-				newRay.origin = cameraOrigin;
-				newRay.direction = normalize(vec3(u, v, w) - cameraOrigin);
-
-				//check intersect with all spheres
-				for (int i = 0; i < spheres.size(); i++)
-				{
-					intersect = intersectSphere(newRay, spheres.at(i),lights.at(0));
-					if (intersect.w != NULL)
-						doesIntersect = true;
-					if ((intersect.w < closestInteresectAndColor.w) && (intersect.w != NULL))
-						closestInteresectAndColor = intersect;
-
-				}
-
-				//check intersect with all planes
-				for (int i = 0; i < planes.size(); i++)
-				{
-					intersect = intersectPlane(newRay, planes.at(i), lights.at(0));
-					if (intersect.w != NULL)
-						doesIntersect = true;
-					if ((intersect.w < closestInteresectAndColor.w) && (intersect.w != NULL))
-						closestInteresectAndColor = intersect;
-				}
-				
-				//check intersect with all triangles
-				for (int i = 0; i < triangles.size(); i++)
-				{
-					intersect = intersectTriangle(newRay, triangles.at(i), lights.at(0));
-					if (intersect.w != NULL)
-						doesIntersect = true;
-					if (intersect.w < closestInteresectAndColor.w && (intersect.w != NULL))
-						closestInteresectAndColor = intersect;
-				}
-				
-				if (doesIntersect == true) //only if there was an intersect this ray, draw pixel
-				{
-					vec3 color = vec3(closestInteresectAndColor);
-					imageBuffer.SetPixel(i, j, color);
-				}
-			}
+		//Only trace again when the key callback picked another scene (or its
+		//file was saved); other events just redraw the finished image
+		unsigned int generation = 0;
+		shared_ptr<const sceneData> selected = sceneCache.Get(sceneFiles[scene - 1], &generation);
+		if (selected && generation != shownGeneration)
+		{
+			activeScene = selected.get();
+			shownScene = selected;
+			shownGeneration = generation;
+
+			// call function to draw our scene
+			auto frameStart = chrono::high_resolution_clock::now();
+			RenderScene(imageBuffer, scheduler);
+			imageBuffer.Render();
+			reportStats(options, chrono::duration<double>(
+				chrono::high_resolution_clock::now() - frameStart).count());
 		}
-
-		imageBuffer.Render();
+		else
+			imageBuffer.Render();
 
         // scene is rendered to the back buffer, so swap to front for display
         glfwSwapBuffers(window);
@@ -548,9 +1082,990 @@ int main(int argc, char *argv[])
     // clean up allocated resources before exit
     glfwDestroyWindow(window);
     glfwTerminate();
+	if (!options.traceFile.empty() && !writeTrace(options.traceFile))
+		return -1;
 	return 0;
 }
 
+// --------------------------------------------------------------------------
+// Headless (batch) rendering support
+
+//reads the render options from the command line
+bool ParseArguments(int argc, char *argv[], RenderOptions *options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--scene" && hasValue)
+			options->sceneFile = argv[++i];
+		else if (arg == "--out" && hasValue)
+			options->outFile = argv[++i];
+		else if (arg == "--gbuffer" && hasValue)
+			options->gbufferPrefix = argv[++i];
+		else if (arg == "--convert" && hasValue)
+			options->convertFile = argv[++i];
+		else if (arg == "--mesh" && hasValue)
+			options->meshFile = argv[++i];
+		else if (arg == "--unindexed")
+			options->unindexed = true;
+		else if (arg == "--width" && hasValue)
+			options->width = atoi(argv[++i]);
+		else if (arg == "--height" && hasValue)
+			options->height = atoi(argv[++i]);
+		else if (arg == "--synthetic" && hasValue)
+			options->syntheticTriangles = atoi(argv[++i]);
+		else if (arg == "--threads" && hasValue)
+			options->threads = atoi(argv[++i]);
+		else if (arg == "--no-shadows")
+			castShadows = false;
+		else if (arg == "--no-bvh")
+			useBVH = false;
+		else if (arg == "--no-packets")
+			usePackets = false;
+		else if (arg == "--order" && hasValue)
+		{
+			string name = argv[++i];
+			if (!parsePixelOrder(name, &pixelOrder))
+			{
+				cout << "ERROR: --order must be scanline, morton or hilbert, not " << name << endl;
+				return false;
+			}
+		}
+		else if (arg == "--layout" && hasValue)
+		{
+			string name = argv[++i];
+			if (name == "linear")
+				imageLayout = LINEAR_LAYOUT;
+			else if (name == "tiled")
+				imageLayout = TILED_LAYOUT;
+			else
+			{
+				cout << "ERROR: --layout must be linear or tiled, not " << name << endl;
+				return false;
+			}
+		}
+		else if (arg == "--format" && hasValue)
+		{
+			string name = argv[++i];
+			if (!parsePixelFormat(name, &imageFormat))
+			{
+				cout << "ERROR: --format must be rgb32f, rgb16f, rgb9e5 or rgba8, not " << name << endl;
+				return false;
+			}
+		}
+		else if (arg == "--tonemap")
+			imageEncoding.toneMap = true;
+		else if (arg == "--srgb")
+			imageEncoding.srgb = true;
+		else if (arg == "--dither")
+			imageEncoding.dither = true;
+		else if (arg == "--bench-bvh")
+			options->benchBVH = true;
+		else if (arg == "--bench-threads")
+			options->benchThreads = true;
+		else if (arg == "--bench-parse")
+			options->benchParse = true;
+		else if (arg == "--bench-blocks")
+			options->benchBlocks = true;
+		else if (arg == "--bench-suite")
+			options->benchSuite = true;
+		else if (arg == "--bench-out" && hasValue)
+			options->benchOut = argv[++i];
+		else if (arg == "--heatmap" && hasValue)
+		{
+			string name = argv[++i];
+			if (!parseCostMeasure(name, &pixelCost) || (pixelCost == TEST_COST && !RENDER_STATS))
+			{
+				cout << "ERROR: --heatmap must be cycles or tests (tests need RENDER_STATS), not " << name << endl;
+				return false;
+			}
+		}
+		else if (arg == "--trace" && hasValue)
+		{
+			options->traceFile = argv[++i];
+			startTrace();
+		}
+		else if (arg == "--perf")
+			startPerfCounters();	//without counters, renders as if it was not given
+		else if (arg == "--stats")
+			options->stats = true;
+		else if (arg == "--stats-json" && hasValue)
+			options->statsJson = argv[++i];
+		else if (arg == "--isa" && hasValue)
+		{
+			//kernels are bound from here on, for rendering and benchmarks alike
+			KernelIsa isa;
+			string name = argv[++i];
+			if (!parseIsa(name, &isa) || !selectKernels(isa))
+			{
+				cout << "ERROR: --isa " << name << " is not one this CPU and build support; choose from best";
+				for (int k = 0; k < ISA_COUNT; k++)
+					if (isaAvailable(KernelIsa(k)))
+						cout << " " << isaName(KernelIsa(k));
+				cout << endl;
+				return false;
+			}
+			options->isa = isa;
+		}
+		else
+		{
+			cout << "ERROR: Unknown argument " << arg << endl;
+			cout << "usage: " << argv[0] << " [--scene file | --synthetic n] "
+				<< "[--width w] [--height h] [--out image.ppm] [--gbuffer prefix] [--convert scene.bin] [--mesh file.obj|ply] [--unindexed] [--threads n] "
+				<< "[--no-shadows] [--no-bvh] [--no-packets] [--isa best|baseline|sse4.2|avx2|avx512] "
+				<< "[--order scanline|morton|hilbert] [--layout linear|tiled] [--format rgb32f|rgb16f|rgb9e5|rgba8] "
+				<< "[--tonemap] [--srgb] [--dither] [--heatmap cycles|tests] [--stats] [--stats-json stats.json] [--trace trace.json] [--perf] "
+				<< "[--bench-bvh] [--bench-threads] [--bench-parse] [--bench-blocks] "
+				<< "[--bench-suite [--bench-out results.json|csv]]" << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+//replaces the scene with triangleCount small random triangles in front of
+//the camera, for measuring how render time scales with primitive count
+void generateSyntheticScene(int triangleCount, unsigned int seed, sceneData *scene)
+{
+	scene->Clear();
+
+	light l;
+	l.position = vec3(0, 2.5, -5);
+	l.intensity = 1.0;
+	scene->lights.push_back(l);
+
+	plane back;
+	back.normal = vec3(0, 0, 1);
+	back.position = vec3(0, 0, -20);
+	back.color = vec3(0.5, 0.5, 0.5);
+	scene->planes.push_back(back);
+
+	//shrink the triangles as their number grows, keeping the volume filled
+	mt19937 random(seed);
+	uniform_real_distribution<float> unit(0.0f, 1.0f);
+	float size = 2.0f / pow(float(triangleCount), 1.0f / 3.0f);
+
+	scene->triangles.reserve(triangleCount);
+	for (int i = 0; i < triangleCount; i++)
+	{
+		vec3 center(unit(random) * 8 - 4, unit(random) * 8 - 4, unit(random) * -10 - 5);
+		triangle t;
+		t.P0 = center + size * vec3(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f);
+		t.P1 = center + size * vec3(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f);
+		t.P2 = center + size * vec3(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f);
+		t.color = vec3(unit(random), unit(random), unit(random));
+		scene->triangles.push_back(t);
+	}
+	scene->Prepare();
+}
+
+//loads the scene the options ask for, either synthetic or from a file, and
+//adds the --mesh file to it if one is given
+bool loadScene(const RenderOptions &options, sceneData *scene)
+{
+	if (options.syntheticTriangles > 0)
+		generateSyntheticScene(options.syntheticTriangles, 453, scene);
+	else if (!loadAllObjects(options.sceneFile, scene))
+		return false;
+	if (options.meshFile.empty())
+		return true;
+
+	TRACE_SCOPE("import mesh");
+	int firstVertex = scene->meshVertices.size();
+	meshImportStats stats;
+	if (!importMesh(options.meshFile, vec3(0.8, 0.8, 0.8), scene, &stats))
+		return false;
+	fitVertices(scene->meshVertices, firstVertex, vec3(0, -0.5, -7.75), 3.0f);
+
+	double megabytes = stats.bytes / (1024.0 * 1024.0);
+	cout << options.meshFile << ": " << stats.vertices << " vertices, " << stats.faces << " faces, "
+		<< stats.triangles << " triangles in " << stats.seconds * 1000.0 << " ms ("
+		<< megabytes / stats.seconds << " MB/s, "
+		<< stats.triangles / stats.seconds / 1.0e6 << " Mtriangles/s)" << endl;
+
+	//what the tracer keeps per mesh triangle, either way, if there are any
+	if (scene->MeshTriangleCount() == 0)
+		return true;
+	double indexedBytes = double(scene->meshVertices.size() * sizeof(vec3) +
+		scene->meshIndices.size() * sizeof(unsigned int)) / scene->MeshTriangleCount();
+	if (options.unindexed)
+		expandMeshes(scene);
+	cout << "mesh storage: " << (options.unindexed ? sizeof(preparedTriangle) : indexedBytes)
+		<< " bytes per triangle (" << (options.unindexed ? "unindexed" : "indexed")
+		<< "), not counting the BVH's copy" << endl;
+	return true;
+}
+
+//scales and moves vertices [first, end) so their bounding box is centred on
+//center with its longest side size long; meshes come in any units
+void fitVertices(vector<vec3> &vertices, int first, vec3 center, float size)
+{
+	if (first >= vertices.size())
+		return;
+
+	vec3 lower = vertices[first], upper = lower;
+	for (int i = first; i < vertices.size(); i++)
+	{
+		lower = glm::min(lower, vertices[i]);
+		upper = glm::max(upper, vertices[i]);
+	}
+
+	vec3 extent = upper - lower;
+	float longest = std::max(extent.x, std::max(extent.y, extent.z));
+	float scale = longest > 0 ? size / longest : 1.0f;
+	vec3 middle = (lower + upper) * 0.5f;
+	for (int i = first; i < vertices.size(); i++)
+		vertices[i] = center + (vertices[i] - middle) * scale;
+}
+
+//replaces every mesh triangle with a separate triangle, the way meshes were
+//stored before indexing; both the record (which --convert writes) and its
+//prepared form (which is traced) are added, since a binary scene has no
+//records for Prepare() to rebuild the rest from
+void expandMeshes(sceneData *scene)
+{
+	for (int m = 0; m < scene->meshes.size(); m++)
+	{
+		const mesh &source = scene->meshes[m];
+		for (int i = source.firstTriangle; i < source.firstTriangle + source.triangleCount; i++)
+		{
+			triangle t;
+			t.P0 = scene->meshVertices[scene->meshIndices[3 * i]];
+			t.P1 = scene->meshVertices[scene->meshIndices[3 * i + 1]];
+			t.P2 = scene->meshVertices[scene->meshIndices[3 * i + 2]];
+			t.color = source.color;
+			scene->triangles.push_back(t);
+			scene->preparedTriangles.push_back(prepareTriangle(t));
+		}
+	}
+	scene->meshVertices.clear();
+	scene->meshIndices.clear();
+	scene->meshes.clear();
+}
+
+//renders one frame of the scene into memory and saves it, never calling GLFW
+//or OpenGL, so it runs on machines without a display or GPU
+int RenderHeadless(const RenderOptions &options)
+{
+	ImageBuffer imageBuffer(imageLayout, imageFormat);
+	imageBuffer.SetEncoding(imageEncoding);
+	if (!imageBuffer.Initialize(options.width, options.height))
+		return -1;
+
+	sceneData scene;
+	auto loadStart = chrono::high_resolution_clock::now();
+	if (!loadScene(options, &scene))
+		return -1;
+	auto loadEnd = chrono::high_resolution_clock::now();
+	if (scene.lights.empty())
+	{
+		cout << "ERROR: Scene " << options.sceneFile << " has no lights" << endl;
+		return -1;
+	}
+
+	scene.bvh.Build(scene);
+	activeScene = &scene;
+	auto buildEnd = chrono::high_resolution_clock::now();
+
+	//the BVH traces copies of the triangles in its blocks, whichever way the
+	//mesh is stored, and that copy has to be counted too
+	int triangleCount = int(scene.preparedTriangles.size()) + scene.MeshTriangleCount();
+	if (!options.meshFile.empty() && triangleCount > 0)
+		cout << "BVH triangle blocks: " << double(scene.bvh.TriangleBlockCount()) *
+			sizeof(triangleBlock) / triangleCount << " bytes per triangle, empty lanes included" << endl;
+
+	TileScheduler scheduler(options.threads);
+	GBuffer gbuffer;
+	GBuffer *gbufferTarget = options.gbufferPrefix.empty() && !pixelCost ? 0 : &gbuffer;
+	auto renderStart = chrono::high_resolution_clock::now();
+	RenderScene(imageBuffer, scheduler, gbufferTarget);
+	auto renderEnd = chrono::high_resolution_clock::now();
+
+	double loadSeconds = chrono::duration<double>(loadEnd - loadStart).count();
+	double buildSeconds = chrono::duration<double>(buildEnd - loadEnd).count();
+	double renderSeconds = chrono::duration<double>(renderEnd - renderStart).count();
+	double rays = double(options.width) * options.height;
+	cout << (options.syntheticTriangles > 0 ? "synthetic" : options.sceneFile)
+		<< ": " << options.width << "x" << options.height
+		<< ", load " << loadSeconds * 1000.0 << " ms"
+		<< ", build " << buildSeconds * 1000.0 << " ms"
+		<< ", render " << renderSeconds * 1000.0 << " ms"
+		<< " on " << scheduler.ThreadCount() << " threads"
+		<< " with " << activeKernels.name << " kernels"
+		<< ", " << pixelOrderName(pixelOrder) << " order"
+		<< ", " << pixelFormatName(imageFormat) << " pixels"
+		<< " (" << rays / renderSeconds / 1.0e6 << " Mrays/s)" << endl;
+
+	if (!options.gbufferPrefix.empty() && !saveGBuffer(gbuffer, options.gbufferPrefix))
+		return -1;
+	if (!imageBuffer.SaveToFile(options.outFile))
+		return -1;
+	if (pixelCost && !saveHeatmap(gbuffer, options.outFile))
+		return -1;
+	if (!options.traceFile.empty() && !writeTrace(options.traceFile))
+		return -1;
+	return reportStats(options, renderSeconds) ? 0 : -1;
+}
+
+//prints and/or saves what the threads counted since the last report, for a
+//frame that took frameSeconds, with the hardware counters if --perf opened
+//them, and starts counting afresh; only call it while no tiles are rendering
+bool reportStats(const RenderOptions &options, double frameSeconds)
+{
+	if (perfEnabled)
+	{
+		printPerfCounters(cout, collectPerfCounters());
+		resetPerfCounters();
+	}
+	if (!options.stats && options.statsJson.empty())
+		return true;
+
+	renderStats stats = collectStats();
+	resetStats();
+	if (options.stats)
+		printStats(cout, stats, frameSeconds);
+	if (options.statsJson.empty())
+		return true;
+
+	ofstream out(options.statsJson);
+	writeStatsJson(out, stats, frameSeconds);
+	if (!out)
+	{
+		cout << "ERROR: Could not write statistics to " << options.statsJson << endl;
+		return false;
+	}
+	return true;
+}
+
+//loads a text scene (or generates a synthetic one) and saves it in the
+//binary format, which loadAllObjects() then maps instead of parsing
+int ConvertScene(const RenderOptions &options)
+{
+	//binary scenes keep no records to write back out
+	MappedFile source;
+	if (options.syntheticTriangles <= 0 && source.Open(options.sceneFile) &&
+		isBinaryScene(source.Data(), source.Size()))
+	{
+		cout << "ERROR: " << options.sceneFile << " is already a binary scene" << endl;
+		return -1;
+	}
+	source.Close();
+
+	sceneData scene;
+	if (!loadScene(options, &scene))
+		return -1;
+
+	if (!writeBinaryScene(options.convertFile, scene))
+		return -1;
+
+	cout << "wrote " << scene.lights.size() << " lights, " << scene.spheres.size() << " spheres, "
+		<< scene.planes.size() << " planes, " << scene.triangles.size() << " triangles and "
+		<< scene.meshes.size() << " meshes to " << options.convertFile << endl;
+	return 0;
+}
+
+//writes viewable copies of the G-buffer: depth as grey (near is bright),
+//normals mapped from [-1,1] to [0,1], and one flat colour per primitive
+bool saveGBuffer(const GBuffer &gbuffer, const string &prefix)
+{
+	float maxDepth = 0;
+	for (int i = 0; i < gbuffer.depth.size(); i++)
+		maxDepth = max(maxDepth, gbuffer.depth[i]);
+
+	ImageBuffer depth, normal, primitive;
+	depth.Initialize(gbuffer.width, gbuffer.height);
+	normal.Initialize(gbuffer.width, gbuffer.height);
+	primitive.Initialize(gbuffer.width, gbuffer.height);
+
+	for (int j = 0; j < gbuffer.height; j++)
+	{
+		for (int i = 0; i < gbuffer.width; i++)
+		{
+			int index = j * gbuffer.width + i;
+			const primitiveRef &p = gbuffer.primitive[index];
+			if (p.index < 0)
+			{
+				depth.SetPixel(i, j, vec3(0, 0, 0));
+				normal.SetPixel(i, j, vec3(0, 0, 0));
+				primitive.SetPixel(i, j, vec3(0, 0, 0));
+				continue;
+			}
+
+			depth.SetPixel(i, j, vec3(1.0f - gbuffer.depth[index] / maxDepth));
+			normal.SetPixel(i, j, gbuffer.normal[index] * 0.5f + vec3(0.5f));
+
+			unsigned int hash = (p.index + 1) * 2654435761u + p.type * 40503u;
+			primitive.SetPixel(i, j, vec3((hash & 255) / 255.0f,
+				((hash >> 8) & 255) / 255.0f, ((hash >> 16) & 255) / 255.0f));
+		}
+	}
+
+	return depth.SaveToFile(prefix + "_depth.ppm") &&
+		normal.SaveToFile(prefix + "_normal.ppm") &&
+		primitive.SaveToFile(prefix + "_id.ppm");
+}
+
+//Maps x in [0, 1] from black through purple, red and orange to pale yellow,
+//a ramp that stays ordered when printed in grey
+vec3 heatColor(float x)
+{
+	const vec3 ramp[] = { vec3(0, 0, 0), vec3(0.34f, 0.06f, 0.43f), vec3(0.73f, 0.21f, 0.33f),
+		vec3(0.98f, 0.55f, 0.04f), vec3(0.99f, 1.0f, 0.64f) };
+	const int steps = sizeof(ramp) / sizeof(ramp[0]) - 1;
+	float position = glm::clamp(x, 0.0f, 1.0f) * steps;
+	int k = std::min(int(position), steps - 1);
+	return mix(ramp[k], ramp[k + 1], position - k);
+}
+
+//writes the G-buffer's per-pixel cost as a false colour image next to
+//imageFile, as name_heatmap.ext; the ramp spans the 1st to 99th percentile,
+//so a few outliers (a page fault, a preempted thread) do not wash it out
+bool saveHeatmap(const GBuffer &gbuffer, const string &imageFile)
+{
+	vector<float> sorted(gbuffer.cost);
+	if (sorted.empty())
+		return false;
+	size_t bottom = sorted.size() / 100, top = sorted.size() * 99 / 100;
+	nth_element(sorted.begin(), sorted.begin() + top, sorted.end());
+	float highest = sorted[top];
+	nth_element(sorted.begin(), sorted.begin() + bottom, sorted.begin() + top);
+	float lowest = sorted[bottom];
+	float scale = highest > lowest ? 1.0f / (highest - lowest) : 0.0f;
+
+	ImageBuffer heatmap;
+	heatmap.Initialize(gbuffer.width, gbuffer.height);
+	double total = 0;
+	for (int j = 0; j < gbuffer.height; j++)
+	{
+		for (int i = 0; i < gbuffer.width; i++)
+		{
+			float cost = gbuffer.cost[j * gbuffer.width + i];
+			total += cost;
+			heatmap.SetPixel(i, j, heatColor((cost - lowest) * scale));
+		}
+	}
+
+	size_t dot = imageFile.find_last_of('.');
+	size_t slash = imageFile.find_last_of("/\\");
+	if (dot == string::npos || (slash != string::npos && dot < slash))
+		dot = imageFile.size();
+	string name = imageFile.substr(0, dot) + "_heatmap" + imageFile.substr(dot);
+	cout << "heatmap of " << costMeasureName(pixelCost) << " per pixel: mean "
+		<< total / gbuffer.cost.size() << ", black at " << lowest << " and brightest at "
+		<< highest << " (1st and 99th percentile)" << endl;
+	return heatmap.SaveToFile(name);
+}
+
+//renders synthetic scenes of growing size with and without the BVH and
+//prints one row per size; linear cost is only measured while it is bearable
+int RunBVHBenchmark(TileScheduler &scheduler)
+{
+	const int size = 128;
+	const int maxLinearTriangles = 10000;
+	ImageBuffer imageBuffer(imageLayout, imageFormat);
+	imageBuffer.Initialize(size, size);
+	sceneData scene;
+	activeScene = &scene;
+
+	cout << "triangles,bvh_nodes,build_ms,bvh_ns_per_ray,linear_ns_per_ray" << endl;
+	for (int count = 10; count <= 1000000; count *= 10)
+	{
+		generateSyntheticScene(count, 453, &scene);
+
+		auto buildStart = chrono::high_resolution_clock::now();
+		scene.bvh.Build(scene);
+		auto buildEnd = chrono::high_resolution_clock::now();
+
+		useBVH = true;
+		RenderScene(imageBuffer, scheduler);
+		auto bvhEnd = chrono::high_resolution_clock::now();
+
+		double linearSeconds = 0;
+		if (count <= maxLinearTriangles)
+		{
+			useBVH = false;
+			RenderScene(imageBuffer, scheduler);
+			linearSeconds = chrono::duration<double>(chrono::high_resolution_clock::now() - bvhEnd).count();
+		}
+
+		double rays = double(size) * size;
+		double buildSeconds = chrono::duration<double>(buildEnd - buildStart).count();
+		double bvhSeconds = chrono::duration<double>(bvhEnd - buildEnd).count();
+		cout << count << "," << scene.bvh.NodeCount() << "," << buildSeconds * 1000.0
+			<< "," << bvhSeconds / rays * 1.0e9 << ",";
+		if (count <= maxLinearTriangles)
+			cout << linearSeconds / rays * 1.0e9;
+		cout << endl;
+	}
+	useBVH = true;
+	return 0;
+}
+
+//renders scene1-3 and a large synthetic scene with 1, 2, 4, ... threads up to
+//maxThreads (0 for one per core) and prints the speedup over one thread
+int RunThreadBenchmark(int maxThreads)
+{
+	const int size = 512;
+	const int syntheticTriangles = 100000;
+	if (maxThreads <= 0)
+		maxThreads = std::max(1, int(thread::hardware_concurrency()));
+
+	vector<int> threadCounts;
+	for (int n = 1; n < maxThreads; n *= 2)
+		threadCounts.push_back(n);
+	threadCounts.push_back(maxThreads);
+
+	ImageBuffer imageBuffer(imageLayout, imageFormat);
+	imageBuffer.Initialize(size, size);
+
+	const char *sceneNames[] = { "scene1.txt", "scene2.txt", "scene3.txt", "synthetic" };
+	cout << "scene,threads,render_ms,mrays_per_s,speedup" << endl;
+	for (int s = 0; s < 4; s++)
+	{
+		string name = sceneNames[s];
+		sceneData scene;
+		if (name == "synthetic")
+			generateSyntheticScene(syntheticTriangles, 453, &scene);
+		else
+			loadAllObjects(name, &scene);
+		if (scene.lights.empty())
+			continue;
+		scene.bvh.Build(scene);
+		activeScene = &scene;
+
+		double singleSeconds = 0;
+		for (int k = 0; k < threadCounts.size(); k++)
+		{
+			TileScheduler scheduler(threadCounts[k]);
+			auto start = chrono::high_resolution_clock::now();
+			RenderScene(imageBuffer, scheduler);
+			double seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+			if (k == 0)
+				singleSeconds = seconds;
+
+			cout << name << "," << threadCounts[k] << "," << seconds * 1000.0 << ","
+				<< double(size) * size / seconds / 1.0e6 << ","
+				<< singleSeconds / seconds << endl;
+		}
+	}
+	return 0;
+}
+
+//writes the scene in the text format loadAllObjects() reads, with enough
+//digits that every value reads back exactly
+bool writeSceneFile(const string &filename, const sceneData &scene)
+{
+	ofstream file(filename);
+	if (!file)
+		return false;
+	file.precision(9);
+
+	for (int i = 0; i < scene.lights.size(); i++)
+	{
+		const light &l = scene.lights[i];
+		file << "light {\n" << l.position.x << " " << l.position.y << " " << l.position.z
+			<< "\n" << l.intensity << "\n}\n";
+	}
+	for (int i = 0; i < scene.planes.size(); i++)
+	{
+		const plane &p = scene.planes[i];
+		file << "plane {\n" << p.normal.x << " " << p.normal.y << " " << p.normal.z
+			<< "\n" << p.position.x << " " << p.position.y << " " << p.position.z
+			<< "\n" << p.color.x << " " << p.color.y << " " << p.color.z << "\n}\n";
+	}
+	for (int i = 0; i < scene.spheres.size(); i++)
+	{
+		const sphere &s = scene.spheres[i];
+		file << "sphere {\n" << s.center.x << " " << s.center.y << " " << s.center.z
+			<< "\n" << s.radius
+			<< "\n" << s.color.x << " " << s.color.y << " " << s.color.z << "\n}\n";
+	}
+	for (int i = 0; i < scene.triangles.size(); i++)
+	{
+		const triangle &t = scene.triangles[i];
+		file << "triangle {\n" << t.P0.x << " " << t.P0.y << " " << t.P0.z
+			<< "\n" << t.P1.x << " " << t.P1.y << " " << t.P1.z
+			<< "\n" << t.P2.x << " " << t.P2.y << " " << t.P2.z
+			<< "\n" << t.color.x << " " << t.color.y << " " << t.color.z << "\n}\n";
+	}
+	return bool(file);
+}
+
+//writes a synthetic scene of triangleCount triangles to a temporary text
+//file and prints how fast the iostream and mapped loaders read it back
+int RunParseBenchmark(int triangleCount)
+{
+	const string filename = "parse_benchmark.txt";
+	const int repeats = 3;
+
+	sceneData source;
+	generateSyntheticScene(triangleCount, 453, &source);
+	if (!writeSceneFile(filename, source))
+	{
+		cout << "ERROR: Could not write " << filename << endl;
+		return -1;
+	}
+	ifstream sizeCheck(filename, ios::binary | ios::ate);
+	double megabytes = double(sizeCheck.tellg()) / (1024.0 * 1024.0);
+	sizeCheck.close();
+
+	const char *loaderNames[] = { "iostream", "mapped" };
+	bool (*loaders[])(const string &, sceneData *) = { loadAllObjectsIostream, loadAllObjects };
+
+	int result = 0;
+	cout << "loader,triangles,megabytes,parse_ms,mb_per_s" << endl;
+	for (int k = 0; k < 2; k++)
+	{
+		//best of a few runs, so the first one can warm the page cache
+		double bestSeconds = 0;
+		for (int run = 0; run < repeats; run++)
+		{
+			sceneData scene;
+			auto start = chrono::high_resolution_clock::now();
+			bool loaded = loaders[k](filename, &scene);
+			double seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+			if (!loaded || scene.triangles.size() != source.triangles.size())
+			{
+				cout << "ERROR: " << loaderNames[k] << " loader read the scene back wrong" << endl;
+				result = -1;
+			}
+			if (run == 0 || seconds < bestSeconds)
+				bestSeconds = seconds;
+		}
+
+		cout << loaderNames[k] << "," << triangleCount << "," << megabytes << ","
+			<< bestSeconds * 1000.0 << "," << megabytes / bestSeconds << endl;
+	}
+
+	remove(filename.c_str());
+	return result;
+}
+
+//tests random rays against the triangles of a synthetic scene and against as
+//many spheres, once a primitive at a time with the scalar intersect functions
+//and once a block at a time, and prints the cost of one primitive test each
+//way. The triangles are also copied into a mesh, so the scalar test is the
+//same Moller-Trumbore one the blocks use. Blocks are timed with the kernels
+//of every instruction set the CPU has, or only with isa if it is not -1.
+int RunBlockBenchmark(int isa)
+{
+	const int count = 4096;
+	const int rayCount = 2000;
+
+	sceneData scene;
+	generateSyntheticScene(count, 453, &scene);
+	mesh copy;
+	copy.firstTriangle = 0;
+	copy.triangleCount = count;
+	copy.color = vec3(1, 1, 1);
+	scene.meshes.push_back(copy);
+	for (int i = 0; i < count; i++)
+	{
+		const triangle &t = scene.triangles[i];
+		scene.meshVertices.push_back(t.P0);
+		scene.meshVertices.push_back(t.P1);
+		scene.meshVertices.push_back(t.P2);
+		for (int k = 0; k < 3; k++)
+			scene.meshIndices.push_back(3 * i + k);
+
+		sphere s;
+		s.center = (t.P0 + t.P1 + t.P2) / 3.0f;
+		s.radius = 0.05f;
+		s.color = t.color;
+		scene.spheres.push_back(s);
+	}
+	scene.Prepare();
+	activeScene = &scene;
+
+	int blockCount = (count + BlockWidth - 1) / BlockWidth;
+	vector<triangleBlock> triangleBlocks(blockCount);
+	vector<sphereBlock> sphereBlocks(blockCount);
+	for (int b = 0; b < blockCount; b++)
+	{
+		clearBlock(&triangleBlocks[b]);
+		clearBlock(&sphereBlocks[b]);
+	}
+	for (int i = 0; i < count; i++)
+	{
+		const preparedTriangle &t = scene.preparedTriangles[i];
+		const preparedSphere &s = scene.preparedSpheres[i];
+		primitiveRef p;
+		p.index = i;
+		p.type = TRIANGLE_PRIMITIVE;
+		setLane(&triangleBlocks[i / BlockWidth], i % BlockWidth, t.P0, t.P1, t.P2, p);
+		p.type = SPHERE_PRIMITIVE;
+		setLane(&sphereBlocks[i / BlockWidth], i % BlockWidth, s.center, s.radiusSquared, p);
+	}
+
+	//rays from the camera into the volume the primitives fill
+	mt19937 random(453);
+	uniform_real_distribution<float> unit(-0.4f, 0.4f);
+	vector<ray> rays(rayCount);
+	for (int i = 0; i < rayCount; i++)
+	{
+		rays[i].origin = vec3(0, 0, 0);
+		rays[i].direction = normalize(vec3(unit(random), unit(random), -1));
+	}
+
+	cout << "primitive,count,kernel,scalar_ns_per_test,block_ns_per_test,speedup,scalar_hits,block_hits" << endl;
+	for (int type = 0; type < 2; type++)
+	{
+		bool spheres = type == 1;
+		int scalarHits = 0;
+		float t;
+
+		auto scalarStart = chrono::high_resolution_clock::now();
+		for (int i = 0; i < rayCount; i++)
+		{
+			float tMax = numeric_limits<float>::infinity();
+			bool hit = false;
+			for (int j = 0; j < count; j++)
+			{
+				if (spheres ? intersectSphere(rays[i], scene.preparedSpheres[j], 0, tMax, &t)
+					: intersectMeshTriangle(rays[i], j, 0, tMax, &t))
+				{
+					tMax = t;
+					hit = true;
+				}
+			}
+			scalarHits += hit;
+		}
+		auto scalarEnd = chrono::high_resolution_clock::now();
+		double tests = double(rayCount) * count;
+		double scalarSeconds = chrono::duration<double>(scalarEnd - scalarStart).count();
+
+		for (int k = 0; k < ISA_COUNT; k++)
+		{
+			if ((isa >= 0 && k != isa) || !selectKernels(KernelIsa(k)))
+				continue;
+
+			int blockHits = 0;
+			auto blockStart = chrono::high_resolution_clock::now();
+			for (int i = 0; i < rayCount; i++)
+			{
+				float tMax = numeric_limits<float>::infinity();
+				primitiveRef p;
+				blockHits += spheres
+					? closestHitBlocks(&sphereBlocks[0], blockCount, rays[i], 0, &tMax, &p)
+					: closestHitBlocks(&triangleBlocks[0], blockCount, rays[i], 0, &tMax, &p);
+			}
+			auto blockEnd = chrono::high_resolution_clock::now();
+
+			double blockSeconds = chrono::duration<double>(blockEnd - blockStart).count();
+			cout << (spheres ? "spheres" : "triangles") << "," << count << "," << activeKernels.name << ","
+				<< scalarSeconds / tests * 1.0e9 << "," << blockSeconds / tests * 1.0e9 << ","
+				<< scalarSeconds / blockSeconds << "," << scalarHits << "," << blockHits << endl;
+		}
+	}
+	selectKernels(isa >= 0 ? KernelIsa(isa) : bestIsa());
+	activeScene = 0;
+	return 0;
+}
+
+//runs work repeats times and returns the time of the fastest run, in seconds
+double bestOf(int repeats, const function<void()> &work)
+{
+	double best = 0;
+	for (int run = 0; run < repeats; run++)
+	{
+		auto start = chrono::high_resolution_clock::now();
+		work();
+		double seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+		if (run == 0 || seconds < best)
+			best = seconds;
+	}
+	return best;
+}
+
+//the benchmarks used to compare one build with another: the intersect
+//functions, the Phong kernel and the scene parser on their own, then whole
+//frames of scene1-3 and of synthetic scenes of growing size (or only of
+//--synthetic n) with the current options. Every result is the best of a few
+//runs, and goes to --bench-out as JSON or CSV, or to the console as CSV.
+int RunBenchmarkSuite(const RenderOptions &options)
+{
+	const int repeats = 3;
+	const int primitiveCount = 1024;
+	const int rayCount = 1000;
+	const int shadingPackets = 1024;
+	const int parseTriangles = 100000;
+
+	TileScheduler scheduler(options.threads);
+	BenchmarkReport report;
+	report.SetContext("kernels", activeKernels.name);
+	report.SetContext("threads", to_string(scheduler.ThreadCount()));
+	report.SetContext("width", to_string(options.width));
+	report.SetContext("height", to_string(options.height));
+	report.SetContext("order", pixelOrderName(pixelOrder));
+	report.SetContext("format", pixelFormatName(imageFormat));
+	report.SetContext("packets", usePackets ? "on" : "off");
+	report.SetContext("shadows", castShadows ? "on" : "off");
+
+	//the same random rays against primitiveCount of each kind of primitive;
+	//the hits are counted, and checked, so that no test can be optimised away
+	sceneData scene;
+	generateSyntheticScene(primitiveCount, 453, &scene);
+	mt19937 random(453);
+	uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	for (int i = 0; i < primitiveCount; i++)
+	{
+		const triangle &t = scene.triangles[i];
+		sphere s;
+		s.center = (t.P0 + t.P1 + t.P2) / 3.0f;
+		s.radius = 0.05f;
+		s.color = t.color;
+		scene.spheres.push_back(s);
+
+		plane p;
+		p.normal = normalize(vec3(unit(random), unit(random), unit(random)));
+		p.position = s.center;
+		p.color = t.color;
+		scene.planes.push_back(p);
+	}
+	scene.Prepare();
+
+	vector<ray> rays(rayCount);
+	for (int i = 0; i < rayCount; i++)
+	{
+		rays[i].origin = vec3(0, 0, 0);
+		rays[i].direction = normalize(vec3(unit(random) * 0.4f, unit(random) * 0.4f, -1));
+	}
+
+	int hits = 0;
+	double tests = double(rayCount) * primitiveCount;
+	benchmarkResult result = { "micro", "intersectSphere", primitiveCount, "test", tests, 0 };
+	result.seconds = bestOf(repeats, [&]()
+	{
+		float t;
+		for (int i = 0; i < rayCount; i++)
+			for (int j = 0; j < primitiveCount; j++)
+				hits += intersectSphere(rays[i], scene.preparedSpheres[j], 0, numeric_limits<float>::max(), &t);
+	});
+	report.Add(result);
+
+	result.name = "intersectPlane";
+	result.seconds = bestOf(repeats, [&]()
+	{
+		float t;
+		for (int i = 0; i < rayCount; i++)
+			for (int j = 0; j < primitiveCount; j++)
+				hits += intersectPlane(rays[i], scene.preparedPlanes[j], 0, numeric_limits<float>::max(), &t);
+	});
+	report.Add(result);
+
+	result.name = "intersectTriangle";
+	result.seconds = bestOf(repeats, [&]()
+	{
+		float t;
+		for (int i = 0; i < rayCount; i++)
+			for (int j = 0; j < primitiveCount; j++)
+				hits += intersectTriangle(rays[i], scene.preparedTriangles[j], 0, numeric_limits<float>::max(), &t);
+	});
+	report.Add(result);
+	if (hits == 0)
+		cout << "WARNING: the micro-benchmark rays hit nothing, so they measure misses only" << endl;
+
+	//the Phong kernel over whole packets of random points, all lit
+	vector<shadingPacket> shading(shadingPackets);
+	for (int k = 0; k < shadingPackets; k++)
+		for (int lane = 0; lane < PacketSize; lane++)
+		{
+			vec3 point(unit(random) * 4, unit(random) * 4, unit(random) * 5 - 10);
+			vec3 normal = normalize(vec3(unit(random), unit(random), 1));
+			setShading(&shading[k], lane, point, normal, vec3(0, 0, 0), vec3(0.5f, 0.5f, 0.5f),
+				lane % 2 == 0, ambientIntensity);
+		}
+	result.name = "phong";
+	result.unit = "shade";
+	result.size = 0;
+	result.operations = double(shadingPackets) * PacketSize;
+	result.seconds = bestOf(repeats, [&]()
+	{
+		for (int k = 0; k < shadingPackets; k++)
+			activeKernels.phong(&shading[k], PacketSize, scene.lights[0], ~packetMask(0));
+	});
+	report.Add(result);
+
+	//the scene loader on a text file of parseTriangles triangles, each run
+	//into a scene of its own
+	const string parseFile = "benchmark_suite.txt";
+	sceneData source;
+	generateSyntheticScene(parseTriangles, 453, &source);
+	if (!writeSceneFile(parseFile, source))
+	{
+		cout << "ERROR: Could not write " << parseFile << endl;
+		return -1;
+	}
+	result.name = "loadAllObjects";
+	result.unit = "triangle";
+	result.size = parseTriangles;
+	result.operations = parseTriangles;
+	result.seconds = bestOf(repeats, [&]()
+	{
+		sceneData parsed;
+		loadAllObjects(parseFile, &parsed);
+	});
+	report.Add(result);
+	remove(parseFile.c_str());
+
+	//whole frames, counted in camera rays
+	ImageBuffer imageBuffer(imageLayout, imageFormat);
+	if (!imageBuffer.Initialize(options.width, options.height))
+		return -1;
+	vector<string> frameScenes;
+	frameScenes.push_back("scene1.txt");
+	frameScenes.push_back("scene2.txt");
+	frameScenes.push_back("scene3.txt");
+	vector<int> syntheticSizes;
+	if (options.syntheticTriangles > 0)
+		syntheticSizes.push_back(options.syntheticTriangles);
+	else
+		for (int count = 1000; count <= 100000; count *= 10)
+			syntheticSizes.push_back(count);
+
+	result.group = "frame";
+	result.unit = "ray";
+	result.operations = double(options.width) * options.height;
+	for (int k = 0; k < frameScenes.size() + syntheticSizes.size(); k++)
+	{
+		sceneData frame;
+		if (k < frameScenes.size())
+		{
+			result.name = frameScenes[k];
+			if (!loadAllObjects(result.name, &frame) || frame.lights.empty())
+			{
+				cout << "ERROR: Could not load " << result.name << ", skipping it" << endl;
+				continue;
+			}
+		}
+		else
+		{
+			result.name = "synthetic";
+			generateSyntheticScene(syntheticSizes[k - frameScenes.size()], 453, &frame);
+		}
+		result.size = frame.spheres.size() + frame.planes.size() + frame.triangles.size()
+			+ frame.meshIndices.size() / 3;
+		frame.bvh.Build(frame);
+		activeScene = &frame;
+
+		result.seconds = bestOf(repeats, [&]()
+		{
+			RenderScene(imageBuffer, scheduler);
+		});
+		report.Add(result);
+		activeScene = 0;
+	}
+
+	if (options.benchOut.empty())
+	{
+		report.WriteCsv(cout);
+		return 0;
+	}
+	return report.Save(options.benchOut) ? 0 : -1;
+}
+
 // ==========================================================================
 // SUPPORT FUNCTION DEFINITIONS
 